@@ -8,8 +8,9 @@ namespace inspire {
       private:
       // [Protein; model; chain; aminoacid]
       std::vector<std::tuple<std::string, std::string, std::string, std::string>> RESIDUES;
-      // *.pec/ *.pot file
-      std::ifstream INPUT;
+      // *.pec/ *.pot file if it was opened by its path
+      std::ifstream INPUT_FILE;
+      std::istream &INPUT;
 
       inline static std::string validate_name(std::string output, const std::string extension, const std::string input) {
         if (output.size() == 0 || output.back() == common::filesystem::directory_separator) {
@@ -29,8 +30,7 @@ namespace inspire {
         return output;
       }
 
-      public:
-      Assignator(const std::string &index, const std::string &results) : INPUT(results) {
+      void load(const std::string &index) {
         Index indices(index);
         if (!indices.reset()) {
           throw common::exception::TitledException("The index file is empty or it is not possible to read it.");
@@ -45,6 +45,16 @@ namespace inspire {
         } while (indices.next());
       }
 
+      public:
+      Assignator(const std::string &index, const std::string &results) : INPUT_FILE(results), INPUT(INPUT_FILE) {
+        load(index);
+      }
+
+      // Predictions are read from <results>, e.g. kept in memory
+      Assignator(const std::string &index, std::istream &results) : INPUT(results) {
+        load(index);
+      }
+
       bool next(std::string &protein, std::string &model, std::string &chain, std::string &aminoacid, std::string &value) {
         std::string line;
         if (std::getline(INPUT, line)) {
@@ -67,11 +77,20 @@ namespace inspire {
 
       // Delimiter-separated value file format
       static std::string Csv(char delimiter, const std::string &index, const std::string &results, const std::string &output) {
+        std::string output_path = validate_name(output, ".csv", results);
+        std::ofstream stream(output_path);
+        std::ifstream input(results);
+        Csv(delimiter, index, input, stream);
+        stream.flush();
+        stream.close();
+        return output_path;
+      }
+
+      // Delimiter-separated values of predictions read from <results> are written into <stream>
+      static void Csv(char delimiter, const std::string &index, std::istream &results, std::ostream &stream) {
         if (delimiter == '"') {
           throw common::exception::TitledException("Double quotes are not allowed as a delimiter");
         }
-        std::string output_path = validate_name(output, ".csv", results);
-        std::ofstream stream(output_path);
         Assignator assignator(index, results);
         std::string protein;
         std::string model;
@@ -87,15 +106,21 @@ namespace inspire {
           value = common::string::replace_all(value, '"', "\"\"");
           stream << '"' << protein << '"' << delimiter << '"' << model << '"' << delimiter << '"' << chain << '"' << delimiter << '"' << aminoacid << '"' << delimiter << '"' << value << "\"\n";
         }
-        stream.flush();
-        stream.close();
-        return output_path;
       }
 
       // Aligned file format
       static std::string List(const std::string &index, const std::string &results, const std::string &output) {
         std::string output_path = validate_name(output, ".pes", results);
         std::ofstream stream(output_path);
+        std::ifstream input(results);
+        List(index, input, stream);
+        stream.flush();
+        stream.close();
+        return output_path;
+      }
+
+      // Aligned list of predictions read from <results> is written into <stream>
+      static void List(const std::string &index, std::istream &results, std::ostream &stream) {
         Assignator assignator(index, results);
         std::string protein;
         std::string last_protein;
@@ -126,15 +151,21 @@ namespace inspire {
           last_model = model;
           last_chain = chain;
         }
-        stream.flush();
-        stream.close();
-        return output_path;
       }
 
       // Xml file format
       static std::string Xml(const std::string &index, const std::string &results, const std::string &output) {
         std::string output_path = validate_name(output, ".xml", results);
         std::ofstream stream(output_path);
+        std::ifstream input(results);
+        Xml(index, input, stream);
+        stream.flush();
+        stream.close();
+        return output_path;
+      }
+
+      // XML of predictions read from <results> is written into <stream>
+      static void Xml(const std::string &index, std::istream &results, std::ostream &stream) {
         Assignator assignator(index, results);
         std::string protein;
         std::string last_protein;
@@ -180,9 +211,6 @@ namespace inspire {
                  << "  </model>\n"
                  << "</protein>\n";
         }
-        stream.flush();
-        stream.close();
-        return output_path;
       }
     };
   }
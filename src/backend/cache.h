@@ -0,0 +1,246 @@
+#pragma once
+
+#include "search.h"
+#include "../common/exception.h"
+#include "../common/filesystem.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace inspire {
+  namespace backend {
+    // 64-bit FNV-1a hash of <size> bytes, <hash> is the hash of preceding bytes
+    inline uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+      const unsigned char *bytes = static_cast<const unsigned char*>(data);
+      for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+      }
+      return hash;
+    }
+
+    inline const char *CACHE_MAGIC() {
+      return "INSPiREc";
+    }
+    static const size_t CACHE_MAGIC_LENGTH = 8;
+
+    // Results of already mined queries. The nearest fingerprints of a query depend only on its group, its fingerprint,
+    // the number of mined elements and its excluded siblings, so queries with the same key (e.g. residues of repeated chains) are searched once.
+    // Entries are kept in two generations: when the current one is full, it replaces the previous one, which is dropped,
+    // and an entry found in the previous generation is moved to the current one, so recently used entries survive (an approximate LRU).
+    // The cache can be stored in a file (native byte order):
+    //   header:   CACHE_MAGIC, uint32 VERSION, uint64 signature of the knowledge-base, uint64 number of entries
+    //   entries:  (uint32 length, key, uint32 number of neighbours, (int32 distance, uint32 index of the fingerprint)*)*
+    // NOTE: Indices of fingerprints are valid only in the knowledge-base the results were mined in, hence the signature.
+    class QueryCache {
+      public:
+      static const uint32_t VERSION = 2;
+
+      private:
+      mutable std::mutex MUTEX;
+      // Maximal number of entries in a single generation
+      size_t CAPACITY;
+      std::unordered_map<std::string, std::vector<Neighbour> > CURRENT;
+      std::unordered_map<std::string, std::vector<Neighbour> > PREVIOUS;
+      // Number of entries read from the last loaded file
+      size_t LOADED;
+
+      // Insert an entry into the current generation, the lock must be held
+      void store(const std::string &key, const std::vector<Neighbour> &neighbours) {
+        if (CURRENT.size() >= CAPACITY) {
+          PREVIOUS.clear();
+          PREVIOUS.swap(CURRENT);
+        }
+        CURRENT[key] = neighbours;
+      }
+
+      template<typename T>
+      static void write(std::ostream &stream, const T &value) {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+      }
+
+      template<typename T>
+      static bool read(std::istream &stream, T &value) {
+        return (bool)stream.read(reinterpret_cast<char *>(&value), sizeof(value));
+      }
+
+      static void write(std::ostream &stream, const std::unordered_map<std::string, std::vector<Neighbour> > &entries) {
+        for (auto entries_it = entries.begin(); entries_it != entries.end(); ++entries_it) {
+          write(stream, (uint32_t)entries_it->first.size());
+          stream.write(entries_it->first.data(), entries_it->first.size());
+          write(stream, (uint32_t)entries_it->second.size());
+          for (auto neighbours_it = entries_it->second.begin(); neighbours_it != entries_it->second.end(); ++neighbours_it) {
+            write(stream, (int32_t)neighbours_it->first);
+            write(stream, (uint32_t)neighbours_it->second);
+          }
+        }
+      }
+
+      public:
+      // <entries> Maximal number of cached results, 0 disables the cache
+      QueryCache(size_t entries) : CAPACITY((entries + 1) / 2), LOADED(0) { }
+
+      // Key of a query from the key of its group, the fingerprint padded to the stride of the group,
+      // the number of mined elements and its serialized excluded siblings (see excluded())
+      static std::string key(const std::string &group, const std::string &fingerprint, int limit, const std::string &excluded) {
+        std::string key;
+        key.reserve(group.size() + 1 + sizeof(limit) + excluded.size() + fingerprint.size());
+        key += group;
+        key += '\0';
+        key.append(reinterpret_cast<const char*>(&limit), sizeof(limit));
+        key += excluded;
+        key += fingerprint;
+        return key;
+      }
+
+      // Excluded siblings as a part of a key, i.e. uint32 number of ranges and the ranges themselves;
+      // they are stable across runs (unlike an index into a siblings file) and no exclusion is an empty list of ranges
+      static std::string excluded(const IdRanges &ranges) {
+        uint32_t count = ranges.size();
+        std::string serialized(reinterpret_cast<const char*>(&count), sizeof(count));
+        serialized.append(reinterpret_cast<const char*>(ranges.data()), ranges.size() * sizeof(ranges[0]));
+        return serialized;
+      }
+
+      bool enabled() const {
+        return CAPACITY > 0;
+      }
+
+      // Change the maximal number of cached results, all entries are dropped
+      void capacity(size_t entries) {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        CAPACITY = (entries + 1) / 2;
+        CURRENT.clear();
+        PREVIOUS.clear();
+      }
+
+      // Find the result of a query, returns false if it is not cached
+      bool find(const std::string &key, std::vector<Neighbour> &neighbours) {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        auto entries_it = CURRENT.find(key);
+        if (entries_it != CURRENT.end()) {
+          neighbours = entries_it->second;
+          return true;
+        }
+        entries_it = PREVIOUS.find(key);
+        if (entries_it == PREVIOUS.end()) {
+          return false;
+        }
+        neighbours = entries_it->second;
+        store(key, neighbours);
+        PREVIOUS.erase(key);
+        return true;
+      }
+
+      void insert(const std::string &key, const std::vector<Neighbour> &neighbours) {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        if (CAPACITY > 0) {
+          store(key, neighbours);
+        }
+      }
+
+      // Drop all entries, e.g. when the search engine changes
+      void clear() {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        CURRENT.clear();
+        PREVIOUS.clear();
+      }
+
+      size_t size() const {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        return CURRENT.size() + PREVIOUS.size();
+      }
+
+      size_t loaded() const {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        return LOADED;
+      }
+
+      // Load entries stored for a knowledge-base with the given signature, returns false if the file does not exist or was stored for another knowledge-base
+      bool load(const std::string &path, uint64_t signature) {
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        char magic[CACHE_MAGIC_LENGTH];
+        uint32_t version;
+        uint64_t stored;
+        uint64_t count;
+        if (!stream.read(magic, CACHE_MAGIC_LENGTH) || std::memcmp(magic, CACHE_MAGIC(), CACHE_MAGIC_LENGTH) != 0
+            || !read(stream, version) || version != VERSION || !read(stream, stored) || stored != signature || !read(stream, count)) {
+          return false;
+        }
+        // Lengths read from the file are checked against the rest of the file, so a corrupted file cannot request a huge allocation
+        std::streamoff position = stream.tellg();
+        stream.seekg(0, std::ios::end);
+        uint64_t remaining = stream.tellg() - position;
+        stream.seekg(position);
+        std::lock_guard<std::mutex> lock(MUTEX);
+        LOADED = 0;
+        std::string key;
+        std::vector<Neighbour> neighbours;
+        for (; count > 0; --count) {
+          uint32_t length;
+          uint32_t size;
+          if (!read(stream, length)) {
+            break;
+          }
+          remaining -= sizeof(length);
+          if (length > remaining) {
+            break;
+          }
+          remaining -= length;
+          key.resize(length);
+          if ((length > 0 && !stream.read(&key[0], length)) || !read(stream, size)) {
+            break;
+          }
+          remaining -= sizeof(size);
+          if (size > remaining / (sizeof(int32_t) + sizeof(uint32_t))) {
+            break;
+          }
+          remaining -= size * (sizeof(int32_t) + sizeof(uint32_t));
+          neighbours.resize(size);
+          bool complete = true;
+          for (auto neighbours_it = neighbours.begin(); complete && neighbours_it != neighbours.end(); ++neighbours_it) {
+            int32_t distance;
+            uint32_t index;
+            complete = read(stream, distance) && read(stream, index);
+            *neighbours_it = Neighbour(distance, index);
+          }
+          if (!complete) {
+            break;
+          }
+          if (CAPACITY > 0) {
+            store(key, neighbours);
+            ++LOADED;
+          }
+        }
+        if (count > 0) {
+          throw common::exception::TitledException("The result cache '" + path + "' is truncated");
+        }
+        return true;
+      }
+
+      // Store all entries, the older generation first, so the same entries are in the current generation when the file is loaded
+      // NOTE: The file is written under a temporary name and renamed, so a concurrent reader never sees a partial file.
+      void save(const std::string &path, uint64_t signature) {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        std::string temporary = path + ".tmp";
+        {
+          std::ofstream stream(temporary, std::ios::out | std::ios::binary);
+          if (!stream.is_open()) {
+            throw common::exception::TitledException("It is not possible to write the result cache '" + path + "'");
+          }
+          stream.write(CACHE_MAGIC(), CACHE_MAGIC_LENGTH);
+          // A static constant cannot be bound to a reference without its definition
+          write(stream, (uint32_t)VERSION);
+          write(stream, signature);
+          write(stream, (uint64_t)(CURRENT.size() + PREVIOUS.size()));
+          write(stream, PREVIOUS);
+          write(stream, CURRENT);
+        }
+        common::filesystem::move(temporary, path);
+      }
+    };
+  }
+}
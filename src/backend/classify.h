@@ -58,7 +58,7 @@ namespace inspire {
         load_labels(reader, indices);
       }
 
-      void classify(std::string input, std::string output) {
+      void classify(std::string input, std::string output) const {
         if (output.empty() || output.back() == common::filesystem::directory_separator) {
           size_t i = input.rfind(common::filesystem::directory_separator);
           std::string tmp = (i == input.npos ? input : input.substr(i+1));
@@ -73,6 +73,11 @@ namespace inspire {
         }
         std::ifstream input_file(input);
         std::ofstream output_file(output);
+        classify(input_file, output_file);
+      }
+
+      // Classify mined results read from <input_file>, e.g. kept in memory, and write counts of classes into <output_file>
+      void classify(std::istream &input_file, std::ostream &output_file) const {
         for (auto headers_it = headers.begin(); headers_it != headers.end(); ++headers_it) {
           if (headers_it != headers.begin()) {
             output_file << ':';
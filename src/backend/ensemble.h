@@ -0,0 +1,177 @@
+#pragma once
+
+#include "mine.h"
+#include "../common/exception.h"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace inspire {
+  namespace backend {
+    // Mining of the same query file with several knowledge-bases in a single pass, e.g. knowledge-bases of an ensemble built with different settings.
+    // The query file is read only once and each round of queries is searched by a single pool of threads in all knowledge-bases,
+    // so threads do not wait for each other between knowledge-bases.
+    // NOTE: Results are the same as results of individual knowledge-bases, each knowledge-base has its own output file (see output_name()).
+    class MineEnsemble {
+      private:
+      std::vector<std::unique_ptr<Mine> > MINES;
+
+      // Search tiles of rounds of all knowledge-bases; all threads search the same knowledge-base, so they share its groups in caches,
+      // a thread that finds no tile left moves to the next knowledge-base without waiting for the others
+      void roundThread(size_t thread, std::vector<Mine::Round> &rounds, std::vector<std::vector<Mine::NodeStatistics> > &statistics) {
+        for (size_t m = 0; m < MINES.size(); ++m) {
+          MINES[m]->batchThread(thread % MINES[m]->NODES.size(), rounds[m], statistics[m][thread]);
+        }
+      }
+
+      public:
+      // Add a knowledge-base to the ensemble, the ensemble takes the ownership; siblings loaded by the first knowledge-base are used by the added one too
+      // NOTE: Queries are read by the first knowledge-base, so all knowledge-bases must use the same features of central residues.
+      void add(Mine *mine) {
+        std::unique_ptr<Mine> owned(mine);
+        if (!MINES.empty()) {
+          const Mine &first = *MINES.front();
+          if (mine->FILTERS != first.FILTERS) {
+            throw common::exception::TitledException("All knowledge-bases mined together must use the same features of central residues");
+          }
+          mine->EXCLUDES = first.EXCLUDES;
+          mine->EXCLUDE = first.EXCLUDE;
+          mine->EXCLUDE_KEYS = first.EXCLUDE_KEYS;
+        }
+        MINES.push_back(std::move(owned));
+      }
+
+      size_t size() const {
+        return MINES.size();
+      }
+
+      // The first knowledge-base, it also reads queries
+      Mine &front() {
+        return *MINES.front();
+      }
+
+      void threads(size_t threads) {
+        for (auto mines_it = MINES.begin(); mines_it != MINES.end(); ++mines_it) {
+          (*mines_it)->threads(threads);
+        }
+      }
+
+      void limit(int limit) {
+        for (auto mines_it = MINES.begin(); mines_it != MINES.end(); ++mines_it) {
+          (*mines_it)->limit(limit);
+        }
+      }
+
+      void batch(size_t batch) {
+        for (auto mines_it = MINES.begin(); mines_it != MINES.end(); ++mines_it) {
+          (*mines_it)->batch(batch);
+        }
+      }
+
+      void engine(const std::string &engine) {
+        for (auto mines_it = MINES.begin(); mines_it != MINES.end(); ++mines_it) {
+          (*mines_it)->engine(engine);
+        }
+      }
+
+      void tables(size_t tables) {
+        for (auto mines_it = MINES.begin(); mines_it != MINES.end(); ++mines_it) {
+          (*mines_it)->tables(tables);
+        }
+      }
+
+      void cache(size_t entries) {
+        for (auto mines_it = MINES.begin(); mines_it != MINES.end(); ++mines_it) {
+          (*mines_it)->cache(entries);
+        }
+      }
+
+      void load_excludes(const std::string &path) {
+        for (auto mines_it = MINES.begin(); mines_it != MINES.end(); ++mines_it) {
+          (*mines_it)->load_excludes(path);
+        }
+      }
+
+      void clear_excludes() {
+        for (auto mines_it = MINES.begin(); mines_it != MINES.end(); ++mines_it) {
+          (*mines_it)->clear_excludes();
+        }
+      }
+
+      // Base name of the output file of the <index>-th knowledge-base, i.e. '<OUTPUT>.kb<INDEX>'
+      static std::string output_name(const std::string &input, const std::string &output, size_t index) {
+        return Mine::output_name(input, output) + ".kb" + std::to_string(index);
+      }
+
+      // Mine the query file with all knowledge-bases, results of the i-th knowledge-base are written into '<OUTPUT>.kb<I>.med'
+      // NOTE: Rounds of queries are always used, thus the number of threads of the first knowledge-base is used for all of them.
+      void select(const std::string &input, const std::string &output) {
+        if (MINES.empty()) {
+          throw common::exception::TitledException("There is no knowledge-base to mine with");
+        }
+        Mine &first = *MINES.front();
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::ofstream> streams(MINES.size());
+        for (size_t m = 0; m < MINES.size(); ++m) {
+          streams[m].open(output_name(input, output, m) + ".med");
+          if (!streams[m].is_open()) {
+            throw common::exception::TitledException("It is not possible to create the output file '" + output_name(input, output, m) + ".med'");
+          }
+        }
+        Mine::IngestionStatistics ingestion = {input, 0, 0, 0, 0, 0};
+        std::vector<std::vector<Mine::NodeStatistics> > nodes;
+        std::vector<Mine::CacheStatistics> caches(MINES.size(), Mine::CacheStatistics{0, 0});
+        for (size_t m = 0; m < MINES.size(); ++m) {
+          nodes.push_back(MINES[m]->node_statistics());
+        }
+        QueryReader reader(input, first.FILTERS);
+        Mine::QueryQueue queue(1);
+        std::exception_ptr error;
+        std::thread reader_thread(&Mine::readThread, &first, std::ref(reader), Mine::ROUND, nullptr, std::ref(queue), std::ref(ingestion), std::ref(error));
+        Mine::QueryChunk chunk;
+        while (queue.pop(chunk)) {
+          // Queries are padded by each knowledge-base, so each of them needs its own copy
+          std::vector<Mine::Round> rounds(MINES.size());
+          for (size_t m = 0; m < MINES.size(); ++m) {
+            if (m + 1 < MINES.size()) {
+              rounds[m].QUERIES = chunk.second;
+            } else {
+              rounds[m].QUERIES.swap(chunk.second);
+            }
+            MINES[m]->plan_round(rounds[m], caches[m]);
+          }
+          std::vector<std::vector<Mine::NodeStatistics> > statistics(MINES.size(), std::vector<Mine::NodeStatistics>(first.THREADS, Mine::NodeStatistics{0, 0, 0, 0}));
+          std::vector<std::thread> threads;
+          for (size_t i = 0; i < first.THREADS; ++i) {
+            threads.push_back(std::thread(&MineEnsemble::roundThread, this, i, std::ref(rounds), std::ref(statistics)));
+          }
+          for (auto threads_it = threads.begin(); threads_it != threads.end(); ++threads_it) {
+            threads_it->join();
+          }
+          for (size_t m = 0; m < MINES.size(); ++m) {
+            for (size_t i = 0; i < first.THREADS; ++i) {
+              nodes[m][i % MINES[m]->NODES.size()].add(statistics[m][i]);
+            }
+            MINES[m]->finish_round(rounds[m], streams[m]);
+          }
+        }
+        reader_thread.join();
+        ingestion.READER_STALLS = queue.full_stalls();
+        ingestion.WORKER_STALLS = queue.empty_stalls();
+        ingestion.MILLISECONDS = Mine::milliseconds(start);
+        for (size_t m = 0; m < MINES.size(); ++m) {
+          streams[m].close();
+          MINES[m]->publish(ingestion, nodes[m], caches[m]);
+        }
+        if (error) {
+          std::rethrow_exception(error);
+        }
+        for (auto mines_it = MINES.begin(); mines_it != MINES.end(); ++mines_it) {
+          (*mines_it)->save_cache();
+        }
+      }
+    };
+  }
+}
@@ -0,0 +1,583 @@
+#pragma once
+
+#include "../common/exception.h"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace inspire {
+  namespace backend {
+    // Identifiers of structural elements with the same fingerprint (a posting list) in the order of insertion.
+    // Each identifier is stored as a difference from the previous one (the first one from zero) mapped to an unsigned number by the zigzag encoding
+    // (so that the order need not be ascending) and written as a varint, i.e. 7 bits per byte with the highest bit set if another byte follows.
+    // Identifiers are dense, thus most of them need 1-3 bytes instead of 4 bytes.
+    class Postings {
+      private:
+      const uint8_t *DATA;
+      // Number of identifiers that were not decoded yet
+      size_t LEFT;
+      uint32_t LAST;
+
+      public:
+      Postings(const uint8_t *data, size_t count) : DATA(data), LEFT(count), LAST(0) { }
+
+      // Decode the next identifier, returns false if there is no other identifier
+      bool next(uint32_t &id) {
+        if (LEFT == 0) {
+          return false;
+        }
+        --LEFT;
+        uint32_t value = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+          byte = *DATA++;
+          value |= (uint32_t)(byte & 0x7F) << shift;
+          shift += 7;
+        } while (byte & 0x80);
+        LAST += (value >> 1) ^ (0 - (value & 1));
+        id = LAST;
+        return true;
+      }
+
+      // Skip <count> encoded identifiers starting at <data>, returns where the next identifier starts
+      static const uint8_t *skip(const uint8_t *data, size_t count) {
+        for (; count > 0; --count) {
+          while (*data++ & 0x80) { }
+        }
+        return data;
+      }
+
+      // Append identifier <id> that follows identifier <previous> (0 for the first identifier of a list)
+      static void encode(uint32_t previous, uint32_t id, std::vector<uint8_t> &output) {
+        uint32_t difference = id - previous;
+        uint32_t value = (difference << 1) ^ (0 - (difference >> 31));
+        while (value >= 0x80) {
+          output.push_back((uint8_t)(value | 0x80));
+          value >>= 7;
+        }
+        output.push_back((uint8_t)value);
+      }
+    };
+
+    // Distinct fingerprints of a single group of a knowledge-base stored as a structure of arrays:
+    // all fingerprints are in a single cache-aligned arena with a fixed stride and
+    // identifiers of structural elements are in a compressed sparse row form (OFFSETS) with compressed posting lists (see Postings).
+    // Only the position of every BLOCK-th posting list is stored (BLOCKS), the preceding lists of the same block are skipped when a list is decoded.
+    // The arrays are either owned by the group, or the group is just a view into a memory-mapped image.
+    class FingerprintGroup {
+      public:
+      // Alignment of the arena in bytes (a cache line)
+      static const size_t ALIGNMENT = 64;
+      // Number of posting lists per stored position
+      static const size_t BLOCK = 16;
+
+      private:
+      // Length of fingerprints in bytes
+      size_t LENGTH;
+      // Distance between starts of two consecutive fingerprints in bytes (LENGTH rounded up to whole 64-bit words, padded with zeros)
+      size_t STRIDE;
+      // Number of distinct fingerprints
+      size_t COUNT;
+      // Fingerprints sorted lexicographically, i-th fingerprint starts at FINGERPRINTS + i*STRIDE
+      const char *FINGERPRINTS;
+      // The i-th fingerprint has OFFSETS[i+1]-OFFSETS[i] identifiers
+      const uint32_t *OFFSETS;
+      // Posting lists of fingerprints i*BLOCK start at POSTINGS + BLOCKS[i], the last item is the size of POSTINGS in bytes
+      const uint64_t *BLOCKS;
+      const uint8_t *POSTINGS;
+      // Backing store of the arena if it is owned; it is over-allocated to be able to align the arena to a cache line
+      std::vector<uint64_t> STORAGE;
+      // Backing stores of OFFSETS, BLOCKS and POSTINGS if they are owned
+      std::vector<uint32_t> OFFSETS_STORAGE;
+      std::vector<uint64_t> BLOCKS_STORAGE;
+      std::vector<uint8_t> POSTINGS_STORAGE;
+
+      friend class FingerprintGroupBuilder;
+
+      // Allocate an owned arena for COUNT fingerprints aligned to a cache line, it is filled with zeros
+      char *allocate() {
+        STORAGE.assign((COUNT * STRIDE + ALIGNMENT) / sizeof(uint64_t) + 1, 0);
+        uintptr_t address = reinterpret_cast<uintptr_t>(STORAGE.data());
+        FINGERPRINTS = reinterpret_cast<const char*>((address + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+        return const_cast<char*>(FINGERPRINTS);
+      }
+
+      public:
+      FingerprintGroup() : LENGTH(0), STRIDE(0), COUNT(0), FINGERPRINTS(nullptr), OFFSETS(nullptr), BLOCKS(nullptr), POSTINGS(nullptr) { }
+      // A view into arrays owned by someone else (e.g. a memory-mapped image)
+      FingerprintGroup(size_t length, size_t stride, size_t count, const char *fingerprints, const uint32_t *offsets, const uint64_t *blocks, const uint8_t *postings)
+        : LENGTH(length), STRIDE(stride), COUNT(count), FINGERPRINTS(fingerprints), OFFSETS(offsets), BLOCKS(blocks), POSTINGS(postings) { }
+      // Pointers point into vectors' buffers that survive moving, but not copying
+      FingerprintGroup(const FingerprintGroup&) = delete;
+      FingerprintGroup& operator=(const FingerprintGroup&) = delete;
+      FingerprintGroup(FingerprintGroup&&) = default;
+      FingerprintGroup& operator=(FingerprintGroup&&) = default;
+
+      // A copy that owns all its arrays, e.g. to move a group of a memory-mapped image into the memory of the current NUMA node
+      FingerprintGroup clone() const {
+        FingerprintGroup group;
+        group.LENGTH = LENGTH;
+        group.STRIDE = STRIDE;
+        group.COUNT = COUNT;
+        char *arena = group.allocate();
+        if (COUNT > 0) {
+          std::memcpy(arena, FINGERPRINTS, COUNT * STRIDE);
+        }
+        if (OFFSETS != nullptr) {
+          group.OFFSETS_STORAGE.assign(OFFSETS, OFFSETS + COUNT + 1);
+          group.BLOCKS_STORAGE.assign(BLOCKS, BLOCKS + blocks_count(COUNT));
+          group.POSTINGS_STORAGE.assign(POSTINGS, POSTINGS + postings_size());
+          group.OFFSETS = group.OFFSETS_STORAGE.data();
+          group.BLOCKS = group.BLOCKS_STORAGE.data();
+          group.POSTINGS = group.POSTINGS_STORAGE.data();
+        }
+        return group;
+      }
+
+      // Number of distinct fingerprints
+      size_t size() const {
+        return COUNT;
+      }
+
+      // Length of fingerprints in bytes
+      size_t length() const {
+        return LENGTH;
+      }
+
+      // Number of bytes that should be compared (i.e. including zero padding)
+      size_t stride() const {
+        return STRIDE;
+      }
+
+      const char *fingerprint(size_t index) const {
+        return FINGERPRINTS + index * STRIDE;
+      }
+
+      // Identifiers of structural elements with the given fingerprint
+      Postings ids(size_t index) const {
+        size_t first = index / BLOCK * BLOCK;
+        return Postings(Postings::skip(POSTINGS + BLOCKS[index / BLOCK], OFFSETS[index] - OFFSETS[first]), count(index));
+      }
+
+      // Number of items of BLOCKS for a group with <count> fingerprints
+      static size_t blocks_count(size_t count) {
+        return (count + BLOCK - 1) / BLOCK + 1;
+      }
+
+      // Raw arrays (e.g. to store them in an image)
+      const char *fingerprints() const {
+        return FINGERPRINTS;
+      }
+
+      const uint32_t *offsets() const {
+        return OFFSETS;
+      }
+
+      const uint64_t *blocks() const {
+        return BLOCKS;
+      }
+
+      const uint8_t *postings() const {
+        return POSTINGS;
+      }
+
+      // Size of all posting lists in bytes
+      size_t postings_size() const {
+        return COUNT == 0 ? 0 : BLOCKS[blocks_count(COUNT) - 1];
+      }
+
+      // Number of all identifiers in the group
+      size_t ids_count() const {
+        return COUNT == 0 ? 0 : OFFSETS[COUNT];
+      }
+
+      // Number of structural elements with the given fingerprint
+      size_t count(size_t index) const {
+        return OFFSETS[index + 1] - OFFSETS[index];
+      }
+
+      // Index of a fingerprint padded to the stride, or size() if it is not present
+      size_t find(const char *fingerprint) const {
+        size_t low = 0;
+        size_t high = COUNT;
+        while (low < high) {
+          size_t middle = (low + high) / 2;
+          int comparison = std::memcmp(this->fingerprint(middle), fingerprint, STRIDE);
+          if (comparison == 0) {
+            return middle;
+          } else if (comparison < 0) {
+            low = middle + 1;
+          } else {
+            high = middle;
+          }
+        }
+        return COUNT;
+      }
+    };
+
+    // Collects raw records of a group and packs them into a FingerprintGroup.
+    // Records are kept in a single buffer to avoid a heap allocation per fingerprint during loading.
+    class FingerprintGroupBuilder {
+      private:
+      // Length of fingerprints in bytes
+      size_t LENGTH;
+      // Fingerprints in the order of insertion
+      std::vector<char> FINGERPRINTS;
+      // Identifiers in the order of insertion
+      std::vector<uint32_t> IDS;
+
+      public:
+      FingerprintGroupBuilder() : LENGTH(0) { }
+
+      // Prepare the builder for fingerprints of the given length; all fingerprints in a group must have the same length
+      void length(size_t length) {
+        if (IDS.empty()) {
+          LENGTH = length;
+        } else if (LENGTH != length) {
+          throw common::exception::TitledException("Fingerprints of lengths " + std::to_string(LENGTH) + " and " + std::to_string(length) + " bytes cannot be in the same group");
+        }
+      }
+
+      size_t length() const {
+        return LENGTH;
+      }
+
+      // Buffer for a new record of the structural element 'id' that must be filled with LENGTH bytes of its fingerprint
+      char *add(uint32_t id) {
+        IDS.push_back(id);
+        FINGERPRINTS.resize(FINGERPRINTS.size() + LENGTH);
+        return &FINGERPRINTS[FINGERPRINTS.size() - LENGTH];
+      }
+
+      // Remove the last added record (e.g. if its fingerprint cannot be read)
+      void pop() {
+        IDS.pop_back();
+        FINGERPRINTS.resize(FINGERPRINTS.size() - LENGTH);
+      }
+
+      // Number of added records
+      size_t size() const {
+        return IDS.size();
+      }
+
+      // Move all records of another builder after the records of this builder
+      void append(FingerprintGroupBuilder &other) {
+        length(other.LENGTH);
+        if (IDS.empty()) {
+          FINGERPRINTS.swap(other.FINGERPRINTS);
+          IDS.swap(other.IDS);
+        } else {
+          FINGERPRINTS.insert(FINGERPRINTS.end(), other.FINGERPRINTS.begin(), other.FINGERPRINTS.end());
+          IDS.insert(IDS.end(), other.IDS.begin(), other.IDS.end());
+        }
+        std::vector<char>().swap(other.FINGERPRINTS);
+        std::vector<uint32_t>().swap(other.IDS);
+      }
+
+      // Deduplicate fingerprints and pack them; identifiers of the same fingerprint keep the order of insertion
+      FingerprintGroup build() {
+        FingerprintGroup group;
+        group.LENGTH = LENGTH;
+        group.STRIDE = (LENGTH + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+
+        std::vector<uint32_t> order(IDS.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+          order[i] = i;
+        }
+        const char *fingerprints = FINGERPRINTS.data();
+        size_t length = LENGTH;
+        std::stable_sort(order.begin(), order.end(), [fingerprints, length](uint32_t left, uint32_t right) {
+          return std::memcmp(fingerprints + left * length, fingerprints + right * length, length) < 0;
+        });
+
+        // Count distinct fingerprints to allocate the arena at once
+        size_t count = 0;
+        for (size_t i = 0; i < order.size(); ++i) {
+          if (i == 0 || std::memcmp(fingerprints + order[i-1] * length, fingerprints + order[i] * length, length) != 0) {
+            ++count;
+          }
+        }
+        group.COUNT = count;
+        char *arena = group.allocate();
+
+        group.OFFSETS_STORAGE.reserve(count + 1);
+        group.BLOCKS_STORAGE.reserve(FingerprintGroup::blocks_count(count));
+        // Most of identifiers need at most 3 bytes
+        group.POSTINGS_STORAGE.reserve(IDS.size() * 3);
+        uint32_t previous = 0;
+        for (size_t i = 0; i < order.size(); ++i) {
+          if (i == 0 || std::memcmp(fingerprints + order[i-1] * length, fingerprints + order[i] * length, length) != 0) {
+            size_t index = group.OFFSETS_STORAGE.size();
+            std::memcpy(arena + index * group.STRIDE, fingerprints + order[i] * length, length);
+            group.OFFSETS_STORAGE.push_back(i);
+            if (index % FingerprintGroup::BLOCK == 0) {
+              group.BLOCKS_STORAGE.push_back(group.POSTINGS_STORAGE.size());
+            }
+            previous = 0;
+          }
+          Postings::encode(previous, IDS[order[i]], group.POSTINGS_STORAGE);
+          previous = IDS[order[i]];
+        }
+        group.OFFSETS_STORAGE.push_back(order.size());
+        group.BLOCKS_STORAGE.push_back(group.POSTINGS_STORAGE.size());
+        group.POSTINGS_STORAGE.shrink_to_fit();
+        group.OFFSETS = group.OFFSETS_STORAGE.data();
+        group.BLOCKS = group.BLOCKS_STORAGE.data();
+        group.POSTINGS = group.POSTINGS_STORAGE.data();
+
+        // Release the raw records
+        std::vector<char>().swap(FINGERPRINTS);
+        std::vector<uint32_t>().swap(IDS);
+        return group;
+      }
+    };
+
+    // Precompiled knowledge-base in a single file that is mapped into memory instead of being parsed.
+    // Pages of the mapping are shared by all processes that use the same image.
+    // Layout (native byte order; all sections are aligned to FingerprintGroup::ALIGNMENT bytes from the start of the file):
+    //   header:     MAGIC, uint32 VERSION, uint32 number of filters, uint32 number of groups, uint32 reserved, uint64 file size
+    //   filters:    (uint32 length, characters)*
+    //   groups:     (uint32 key length, key, uint32 length, uint32 stride, uint64 count, uint64 ids count, uint64 postings size,
+    //                uint64 fingerprints offset, uint64 offsets offset, uint64 blocks offset, uint64 postings offset)*
+    //   data:       for each group the arena of fingerprints, the offsets, the positions of blocks and the posting lists (see FingerprintGroup)
+    class KnowledgeBaseImage {
+      public:
+      // Identification of the file format
+      static const char *MAGIC() {
+        return "INSPiREk";
+      }
+      static const size_t MAGIC_LENGTH = 8;
+      // Version of the layout, it must be increased with every incompatible change
+      static const uint32_t VERSION = 2;
+
+      private:
+      boost::interprocess::file_mapping FILE;
+      boost::interprocess::mapped_region REGION;
+      // Features of central residues used to create groups in the image
+      std::set<std::string> FILTERS;
+      // Views of individual groups
+      std::unordered_map<std::string, FingerprintGroup> GROUPS;
+
+      // Sequential reader of the header with bounds checking
+      class Reader {
+        const char *BEGIN;
+        size_t SIZE;
+        size_t POSITION;
+        public:
+        Reader(const char *begin, size_t size) : BEGIN(begin), SIZE(size), POSITION(0) { }
+        const char *skip(size_t length) {
+          if (SIZE - POSITION < length) {
+            throw common::exception::TitledException("The knowledge-base image is truncated");
+          }
+          POSITION += length;
+          return BEGIN + POSITION - length;
+        }
+        template <typename T>
+        T read() {
+          T value;
+          std::memcpy(&value, skip(sizeof(T)), sizeof(T));
+          return value;
+        }
+        std::string read_string() {
+          uint32_t length = read<uint32_t>();
+          return std::string(skip(length), length);
+        }
+        // Pointer to a section of 'length' bytes starting at 'offset'
+        const char *at(uint64_t offset, uint64_t length) const {
+          if (offset > SIZE || SIZE - offset < length || offset % FingerprintGroup::ALIGNMENT != 0) {
+            throw common::exception::TitledException("The knowledge-base image contains an invalid section");
+          }
+          return BEGIN + offset;
+        }
+      };
+
+      template <typename T>
+      static void append(std::string &buffer, const T &value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+      }
+
+      static void append_string(std::string &buffer, const std::string &value) {
+        append(buffer, (uint32_t)value.size());
+        buffer.append(value);
+      }
+
+      static void write(std::ofstream &stream, uint64_t &position, const char *data, size_t length) {
+        stream.write(data, length);
+        position += length;
+      }
+
+      // Fill the file with zeros up to the given offset
+      static void pad(std::ofstream &stream, uint64_t &position, uint64_t offset) {
+        for (; position < offset; ++position) {
+          stream.put('\0');
+        }
+      }
+
+      static uint64_t align(uint64_t offset) {
+        return (offset + FingerprintGroup::ALIGNMENT - 1) / FingerprintGroup::ALIGNMENT * FingerprintGroup::ALIGNMENT;
+      }
+
+      public:
+      // Map an image into memory (read only)
+      KnowledgeBaseImage(const std::string &path) {
+        try {
+          FILE = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+          REGION = boost::interprocess::mapped_region(FILE, boost::interprocess::read_only);
+        } catch (const boost::interprocess::interprocess_exception &e) {
+          throw common::exception::TitledException("It is not possible to map the knowledge-base image '" + path + "': " + e.what());
+        }
+        Reader reader(static_cast<const char*>(REGION.get_address()), REGION.get_size());
+        if (std::memcmp(reader.skip(MAGIC_LENGTH), MAGIC(), MAGIC_LENGTH) != 0) {
+          throw common::exception::TitledException("'" + path + "' is not a knowledge-base image");
+        }
+        uint32_t version = reader.read<uint32_t>();
+        if (version != VERSION) {
+          throw common::exception::TitledException("The knowledge-base image '" + path + "' has version " + std::to_string(version) + ", but version " + std::to_string(VERSION) + " is expected; please compile it again");
+        }
+        uint32_t filters = reader.read<uint32_t>();
+        uint32_t groups = reader.read<uint32_t>();
+        reader.read<uint32_t>();
+        if (reader.read<uint64_t>() != REGION.get_size()) {
+          throw common::exception::TitledException("The knowledge-base image '" + path + "' has an unexpected size");
+        }
+        for (uint32_t i = 0; i < filters; ++i) {
+          FILTERS.insert(reader.read_string());
+        }
+        for (uint32_t i = 0; i < groups; ++i) {
+          std::string key = reader.read_string();
+          uint32_t length = reader.read<uint32_t>();
+          uint32_t stride = reader.read<uint32_t>();
+          uint64_t count = reader.read<uint64_t>();
+          uint64_t ids = reader.read<uint64_t>();
+          uint64_t postings = reader.read<uint64_t>();
+          uint64_t fingerprints_offset = reader.read<uint64_t>();
+          uint64_t offsets_offset = reader.read<uint64_t>();
+          uint64_t blocks_offset = reader.read<uint64_t>();
+          uint64_t postings_offset = reader.read<uint64_t>();
+          const uint32_t *offsets = reinterpret_cast<const uint32_t*>(reader.at(offsets_offset, (count + 1) * sizeof(uint32_t)));
+          const uint64_t *blocks = reinterpret_cast<const uint64_t*>(reader.at(blocks_offset, FingerprintGroup::blocks_count(count) * sizeof(uint64_t)));
+          if (offsets[count] != ids || blocks[FingerprintGroup::blocks_count(count) - 1] != postings) {
+            throw common::exception::TitledException("The knowledge-base image '" + path + "' contains an inconsistent group '" + key + "'");
+          }
+          GROUPS.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(length, stride, count,
+            reader.at(fingerprints_offset, count * stride), offsets, blocks,
+            reinterpret_cast<const uint8_t*>(reader.at(postings_offset, postings))));
+        }
+      }
+
+      // Check whether a file starts as a knowledge-base image (of any version)
+      static bool is_image(const std::string &path) {
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        std::string magic(MAGIC_LENGTH, '\0');
+        return stream.read(&magic[0], MAGIC_LENGTH) && magic == MAGIC();
+      }
+
+      const std::set<std::string> &filters() const {
+        return FILTERS;
+      }
+
+      std::unordered_map<std::string, FingerprintGroup> &groups() {
+        return GROUPS;
+      }
+
+      // Store groups of a knowledge-base created with the given filters
+      static void write(const std::string &path, const std::set<std::string> &filters, const std::unordered_map<std::string, FingerprintGroup> &groups) {
+        // Order groups to make the image reproducible
+        std::vector<std::pair<std::string, const FingerprintGroup*> > ordered;
+        for (auto groups_it = groups.begin(); groups_it != groups.end(); ++groups_it) {
+          ordered.push_back(std::make_pair(groups_it->first, &groups_it->second));
+        }
+        std::sort(ordered.begin(), ordered.end());
+
+        // Size of the header is needed to know where the data start
+        uint64_t header = MAGIC_LENGTH + 4 * sizeof(uint32_t) + sizeof(uint64_t);
+        for (auto filters_it = filters.begin(); filters_it != filters.end(); ++filters_it) {
+          header += sizeof(uint32_t) + filters_it->size();
+        }
+        for (auto ordered_it = ordered.begin(); ordered_it != ordered.end(); ++ordered_it) {
+          header += sizeof(uint32_t) + ordered_it->first.size() + 2 * sizeof(uint32_t) + 7 * sizeof(uint64_t);
+        }
+
+        // Offsets of sections
+        std::vector<uint64_t> offsets;
+        uint64_t offset = align(header);
+        for (auto ordered_it = ordered.begin(); ordered_it != ordered.end(); ++ordered_it) {
+          const FingerprintGroup &group = *ordered_it->second;
+          offsets.push_back(offset);
+          offset = align(offset + group.size() * group.stride());
+          offsets.push_back(offset);
+          offset = align(offset + (group.size() + 1) * sizeof(uint32_t));
+          offsets.push_back(offset);
+          offset = align(offset + FingerprintGroup::blocks_count(group.size()) * sizeof(uint64_t));
+          offsets.push_back(offset);
+          offset = align(offset + group.postings_size());
+        }
+
+        std::string buffer(MAGIC(), MAGIC_LENGTH);
+        append(buffer, (uint32_t)VERSION);
+        append(buffer, (uint32_t)filters.size());
+        append(buffer, (uint32_t)ordered.size());
+        append(buffer, (uint32_t)0);
+        append(buffer, offset);
+        for (auto filters_it = filters.begin(); filters_it != filters.end(); ++filters_it) {
+          append_string(buffer, *filters_it);
+        }
+        for (size_t i = 0; i < ordered.size(); ++i) {
+          const FingerprintGroup &group = *ordered[i].second;
+          append_string(buffer, ordered[i].first);
+          append(buffer, (uint32_t)group.length());
+          append(buffer, (uint32_t)group.stride());
+          append(buffer, (uint64_t)group.size());
+          append(buffer, (uint64_t)group.ids_count());
+          append(buffer, (uint64_t)group.postings_size());
+          append(buffer, offsets[4*i]);
+          append(buffer, offsets[4*i+1]);
+          append(buffer, offsets[4*i+2]);
+          append(buffer, offsets[4*i+3]);
+        }
+
+        std::ofstream stream(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!stream.is_open()) {
+          throw common::exception::TitledException("It is not possible to create the knowledge-base image '" + path + "'");
+        }
+        stream.write(buffer.data(), buffer.size());
+        uint64_t position = buffer.size();
+        for (size_t i = 0; i < ordered.size(); ++i) {
+          const FingerprintGroup &group = *ordered[i].second;
+          pad(stream, position, offsets[4*i]);
+          write(stream, position, group.fingerprints(), group.size() * group.stride());
+          pad(stream, position, offsets[4*i+1]);
+          if (group.size() == 0) {
+            uint32_t zero = 0;
+            write(stream, position, reinterpret_cast<const char*>(&zero), sizeof(zero));
+          } else {
+            write(stream, position, reinterpret_cast<const char*>(group.offsets()), (group.size() + 1) * sizeof(uint32_t));
+          }
+          pad(stream, position, offsets[4*i+2]);
+          if (group.size() == 0) {
+            uint64_t zero = 0;
+            write(stream, position, reinterpret_cast<const char*>(&zero), sizeof(zero));
+          } else {
+            write(stream, position, reinterpret_cast<const char*>(group.blocks()), FingerprintGroup::blocks_count(group.size()) * sizeof(uint64_t));
+          }
+          pad(stream, position, offsets[4*i+3]);
+          write(stream, position, reinterpret_cast<const char*>(group.postings()), group.postings_size());
+        }
+        pad(stream, position, offset);
+        stream.flush();
+        if (!stream) {
+          throw common::exception::TitledException("It is not possible to write the knowledge-base image '" + path + "'");
+        }
+        stream.close();
+      }
+    };
+  }
+}
@@ -1,38 +1,166 @@
 #pragma once
 
 #include "../common/multithread.h"
+#include "../common/numa.h"
+#include "cache.h"
+#include "knowledgebase.h"
+#include "queries.h"
+#include "search.h"
 #include <set>
-#include <unordered_set>
 #include <map>
 #include <unordered_map>
 #include <sstream>
 #include <thread>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <exception>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <random>
 
 namespace inspire {
   namespace backend {
+    // File in the root directory of a knowledge-base with entries removed by updates, i.e. lines '<PROTEIN>\t<FIRST-ID>\t<LAST-ID>'
+    inline const char *TOMBSTONES_FILE() {
+      return "removed.tom";
+    }
+
+    class MineEnsemble;
+
     class Mine {
-      private:
-      // Precomputed number of bits set to one.
-      std::map<int, int> DISTANCES;
+      // Mines a query file with rounds of several knowledge-bases at once
+      friend class MineEnsemble;
 
+      private:
       // Number of parallel threads for data mining
-      char THREADS;
+      size_t THREADS;
       // Number of most similar elements to mine
       int LIMIT;
 
       // Order of features for prefilter fingerprints according to central residue
       const std::set<std::string> FILTERS;
       // Fingerprints and indices of coresponding structural elements binned according to ordered features of central residue
-      std::unordered_map<std::string, std::unordered_map<std::string, std::vector<uint32_t> > > KNOWLEDGE_BASE;
-      // What structural elements should be ignored to prevent overlearning during training (e.g. they are from the same protein)
-      std::unordered_map<int, std::unordered_set<int>*> EXCLUDE;
+      std::unordered_map<std::string, FingerprintGroup> KNOWLEDGE_BASE;
+      // Memory-mapped image backing KNOWLEDGE_BASE if the knowledge-base was opened from a precompiled image
+      std::unique_ptr<KnowledgeBaseImage> IMAGE;
+      // Name of the search engine
+      std::string ENGINE;
+      // Search engine for each group of KNOWLEDGE_BASE
+      std::unordered_map<std::string, std::unique_ptr<SearchEngine> > ENGINES;
+      // Number of hash tables of the approximate engine, i.e. the trade-off between the recall and the speed
+      size_t TABLES;
+      // Only groups assigned to the shard SHARD out of SHARDS are loaded, queries of other groups get empty results
+      size_t SHARD;
+      size_t SHARDS;
+      // NUMA nodes the knowledge-base and the threads of mining are spread over, a single node means that nothing is placed or pinned
+      std::vector<common::numa::Node> NODES;
+      // Index into NODES of the node that owns each group, i.e. the group and its engine are allocated and searched by threads pinned to the node
+      std::unordered_map<std::string, size_t> OWNER;
+      // What structural elements should be ignored to prevent overlearning during training (e.g. they are from the same protein);
+      // all queries from the same line of a siblings file share the same intervals
+      std::vector<IdRanges> EXCLUDES;
+      // Index into EXCLUDES for each query
+      std::unordered_map<int, size_t> EXCLUDE;
+      // Serialized items of EXCLUDES, a part of keys of CACHE
+      std::vector<std::string> EXCLUDE_KEYS;
+
+      // Default maximal number of cached results of queries
+      static const size_t CACHE_ENTRIES = 1 << 16;
+      // Results of already mined queries, so repeated queries are not searched again
+      QueryCache CACHE;
+      // The cache is loaded from this file and stored into it after each query file, empty if the cache is not persistent
+      std::string CACHE_FILE;
       
-      // List of queries
-      // NOTE: Compare with sync_bounded_queue - should occupy less memory, on the other hand it require load file in temporary collection to find out its size and thus is slower.
-      // NOTE: Of course, it could be JSON parser, but this approach allows a parallel parsing.
-      // NOTE: Well, lines could be readed online when necessary, but it would result in delays caused by HDD characteristics.
-      common::multithread::synchronized_queue TASKS;
+      // Number of consecutive queries processed as a single task, results of tasks are written in the order of queries
+      static const size_t CHUNK = 32;
+      // Number of queries from the same group searched at once, 1 means queries are searched one by one
+      size_t BATCH;
+      // Number of queries read at once in the batch mode, tiles are formed only within these queries
+      static const size_t ROUND = 1 << 16;
+
+      // Consecutive queries and the order of the chunk in the query file
+      typedef std::pair<size_t, std::vector<Query> > QueryChunk;
+      typedef common::multithread::BoundedQueue<QueryChunk> QueryQueue;
+
+      // How queries of the last query file were read
+      struct IngestionStatistics {
+        std::string INPUT;
+        size_t QUERIES;
+        size_t CHUNKS;
+        // How many times the reader waited because the queue was full, i.e. mining is slower than reading
+        size_t READER_STALLS;
+        // How many times a worker waited because the queue was empty, i.e. reading is slower than mining
+        size_t WORKER_STALLS;
+        double MILLISECONDS;
+      };
+      IngestionStatistics INGESTION;
+      // Guards the statistics of the last query file, each query file is counted apart and published when it is finished,
+      // so query files can be mined concurrently (e.g. by requests of a server)
+      mutable std::mutex STATISTICS_MUTEX;
+
+      // Queries read at once in the batch mode and how they are searched
+      struct Round {
+        std::vector<Query> QUERIES;
+        // Group of each query, nullptr if there is no such group
+        std::vector<const FingerprintGroup*> GROUPS;
+        // Tiles of queries from the same group (in the order of the input)
+        std::vector<std::pair<const FingerprintGroup*, std::vector<size_t> > > TILES;
+        // Tiles of groups owned by individual nodes (still in the order of the input), with the next tile to take from each of them
+        std::vector<std::vector<size_t> > OWNED;
+        std::unique_ptr<std::atomic<size_t>[]> NEXT;
+        std::vector<std::vector<Neighbour> > RESULTS;
+        // Keys of queries in CACHE; a cached query or a repeated query of this round (see SAME) is not searched
+        std::vector<std::string> KEYS;
+        std::vector<char> CACHED;
+        // Index of the same query that is searched instead, or the number of queries
+        std::vector<size_t> SAME;
+      };
+
+      // How threads of a single node mined the last query file
+      struct NodeStatistics {
+        size_t THREADS;
+        size_t QUERIES;
+        // Queries of groups owned by other nodes, they are taken when there is nothing left for the node
+        size_t STOLEN;
+        // Time spent by mining summed over threads of the node
+        double MILLISECONDS;
+
+        void add(const NodeStatistics &other) {
+          THREADS += other.THREADS;
+          QUERIES += other.QUERIES;
+          STOLEN += other.STOLEN;
+          MILLISECONDS += other.MILLISECONDS;
+        }
+      };
+      std::vector<NodeStatistics> NODE_STATISTICS;
+
+      // How many queries of the last query file were looked up in CACHE and how many of them were found
+      struct CacheStatistics {
+        size_t LOOKUPS;
+        size_t HITS;
+
+        void add(const CacheStatistics &other) {
+          LOOKUPS += other.LOOKUPS;
+          HITS += other.HITS;
+        }
+      };
+      CacheStatistics CACHE_STATISTICS;
+
+      // Time spent by reading a single file or by packing a single group of the knowledge-base
+      struct LoadTiming {
+        // 'file', 'group' or 'image'
+        std::string KIND;
+        std::string NAME;
+        // Number of read records, or number of distinct fingerprints of a group
+        size_t COUNT;
+        double MILLISECONDS;
+      };
+      std::vector<LoadTiming> TIMINGS;
+      // Wall time of loading the whole knowledge-base
+      double LOAD_MILLISECONDS;
 
 
       // Check whether file path contains all requered features and check its extension.
@@ -48,170 +176,518 @@ namespace inspire {
         return true;
       }
 
-      // Create unique key from features to ensure it konsistency between knowledge-base loading and prediction
-      std::string create_key(std::map<std::string, std::string>& features) {
-        //? Will be some 'stringbuilder' e.g. std::stringstream significantly more effective?
-        std::string ret;
-        for (auto features_it = features.begin(); features_it != features.end(); ++features_it) {
-          if (!ret.empty()) {
-            ret += ".";
+      static double milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      }
+
+      // Read records of a single knowledge-base file, returns false if the file cannot be read
+      // <removed> Records of these structural elements are skipped
+      static bool load_file(const std::string &path, const Siblings &removed, FingerprintGroupBuilder &group) {
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        if (!stream.is_open()) {
+          return false;
+        }
+        uint32_t length;
+        if (!stream.read(reinterpret_cast<char *>(&length), sizeof(length))) {
+          return false;
+        }
+        group.length(length);
+        while (stream.peek() != EOF) {
+          uint32_t id;
+          stream.read(reinterpret_cast<char *>(&id), sizeof(id));
+          if (!stream.read(group.add(id), length) || removed.contains(id)) {
+            group.pop();
           }
-          ret += features_it->second;
         }
-        return ret;
+        return true;
       }
 
-      // Load queries
-      void load_tasks(std::string path) {
-        std::ifstream input(path);
-        std::string line;
-        while (std::getline(input, line)) {
-          TASKS.push(line);
+      Siblings siblings(const int id) {
+        auto siblings_it = EXCLUDE.find(id);
+        return Siblings(siblings_it == EXCLUDE.end() ? nullptr : &EXCLUDES[siblings_it->second]);
+      }
+
+      // Key of a prepared query in CACHE
+      std::string cache_key(const Query &query) const {
+        static const std::string none = QueryCache::excluded(IdRanges());
+        auto siblings_it = EXCLUDE.find(query.ID);
+        return QueryCache::key(query.KEY, query.FINGERPRINT, LIMIT, siblings_it == EXCLUDE.end() ? none : EXCLUDE_KEYS[siblings_it->second]);
+      }
+
+      // Hash of the loaded knowledge-base and of settings of the engine that affect results; cached results are valid only for the same signature.
+      // Exact engines return the same results, so they share the signature.
+      uint64_t signature() const {
+        std::string engine = (ENGINE == "lsh" ? ENGINE + std::to_string(TABLES) : "exact");
+        uint64_t hash = fnv1a(engine.c_str(), engine.size() + 1);
+        for (auto filters_it = FILTERS.begin(); filters_it != FILTERS.end(); ++filters_it) {
+          hash = fnv1a(filters_it->c_str(), filters_it->size() + 1, hash);
+        }
+        std::vector<std::string> names;
+        for (auto groups_it = KNOWLEDGE_BASE.begin(); groups_it != KNOWLEDGE_BASE.end(); ++groups_it) {
+          names.push_back(groups_it->first);
         }
+        std::sort(names.begin(), names.end());
+        for (auto names_it = names.begin(); names_it != names.end(); ++names_it) {
+          const FingerprintGroup &group = KNOWLEDGE_BASE.at(*names_it);
+          uint64_t sizes[] = {group.length(), group.size(), group.ids_count(), group.postings_size()};
+          hash = fnv1a(names_it->c_str(), names_it->size() + 1, hash);
+          hash = fnv1a(sizes, sizeof(sizes), hash);
+          if (group.size() > 0) {
+            hash = fnv1a(group.fingerprints(), group.size() * group.stride(), hash);
+            hash = fnv1a(group.offsets(), (group.size() + 1) * sizeof(uint32_t), hash);
+            hash = fnv1a(group.postings(), group.postings_size(), hash);
+          }
+        }
+        return hash;
       }
 
-      std::vector<uint32_t> filter_siblings(const int id, const std::vector<uint32_t> &fingerprints) {
-        // Sibilings are not defined.
-        if (EXCLUDE.size() == 0) {
-          return fingerprints;
+      // (Re)create search engines for all groups
+      void create_engines() {
+        ENGINES.clear();
+        std::vector<std::string> names;
+        for (auto groups_it = KNOWLEDGE_BASE.begin(); groups_it != KNOWLEDGE_BASE.end(); ++groups_it) {
+          names.push_back(groups_it->first);
+          // All items are inserted in advance, so the map is not modified by parallel threads
+          ENGINES[groups_it->first];
         }
+        parallel_for_owners(names, [&](size_t i) {
+          ENGINES.at(names[i]).reset(create_engine(ENGINE, KNOWLEDGE_BASE.at(names[i]), TABLES));
+        });
+      }
 
-        //? Initialize buffer for fingerprints.size() length - some indices can be filtered out, but it is just temporary structure, so resizing could lead to worse performance
-        std::vector<uint32_t> ret;
-        //? 'for each' is not C++ construct - it is only in Visual C++, right?
-        for (auto it = fingerprints.begin(); it != fingerprints.end(); it++) {
-          auto siblings = EXCLUDE.find(id);
-          if (siblings == EXCLUDE.end() || siblings->second->find(*it) == siblings->second->end()) {
-            ret.push_back(*it);
+      // Number of threads of mining pinned to the node, threads are assigned to NODES in turn
+      size_t node_threads(size_t node) const {
+        return THREADS / NODES.size() + (node < THREADS % NODES.size() ? 1 : 0);
+      }
+
+      // Assign groups to NODES in the same way as to shards, so all nodes own groups of similar total sizes
+      void assign_owners(const std::map<std::string, uint64_t> &sizes) {
+        OWNER.clear();
+        if (NODES.size() > 1) {
+          const std::map<std::string, size_t> &owners = partition(sizes, NODES.size());
+          OWNER.insert(owners.begin(), owners.end());
+        }
+      }
+
+      // Run task(i) for each group <names>[i] by a thread pinned to the node that owns the group,
+      // so the memory allocated by the task is placed on the node (the first-touch policy of the system)
+      void parallel_for_owners(const std::vector<std::string> &names, const std::function<void(size_t)> &task) {
+        if (NODES.size() < 2) {
+          common::multithread::parallel_for(names.size(), THREADS, task);
+          return;
+        }
+        std::vector<std::vector<size_t> > owned(NODES.size());
+        for (size_t i = 0; i < names.size(); ++i) {
+          owned[OWNER.at(names[i])].push_back(i);
+        }
+        std::vector<std::exception_ptr> errors(NODES.size());
+        std::vector<std::thread> threads;
+        for (size_t node = 0; node < NODES.size(); ++node) {
+          threads.push_back(std::thread([&, node]() {
+            // Threads started by parallel_for inherit the affinity
+            common::numa::pin(NODES[node]);
+            try {
+              common::multithread::parallel_for(owned[node].size(), node_threads(node), [&](size_t i) {
+                task(owned[node][i]);
+              });
+            } catch (...) {
+              errors[node] = std::current_exception();
+            }
+          }));
+        }
+        for (auto threads_it = threads.begin(); threads_it != threads.end(); ++threads_it) {
+          threads_it->join();
+        }
+        for (auto errors_it = errors.begin(); errors_it != errors.end(); ++errors_it) {
+          if (*errors_it) {
+            std::rethrow_exception(*errors_it);
           }
         }
-        return ret;
       }
 
-      void selectThread(std::string output) {
-        std::ofstream stream(output);
-        std::string line;
-        while (TASKS.try_pull(line) == boost::queue_op_status::success) {
-          int id;
-          std::string key;
-          //? How much effective is to initialize with size? It is expected that all fingerprints have the same size but in principle every fingerprint could have a different length.
-          std::string fingerprint;
-          {
-            std::stringstream stream(line);
-
-            // Load id of task
-            if (!std::getline(stream, key, '\t')) { continue; }
-            id = std::stoi(key);
-
-            // Load features of central residue
-            std::map<std::string, std::string> features;
-            //? Will be "value" as constant for whole program or it will be created every iteration?
-            while (std::getline(stream, key, ':') && !stream.eof()) {
-              std::string value;
-              std::getline(stream, value, '\t');
-              std::set<std::string>::iterator it = FILTERS.find(key);
-              if (it != FILTERS.end()) {
-                // TODO: Binning of the feature. Maybe JSON file for creation of fingerprints can be reused. Just optional.
-                features.insert({key, value});
-              }
+      // At least one element must be mined
+      static void check_limit(int limit) {
+        if (limit < 1) {
+          throw common::exception::TitledException("Number of the most similar elements must be positive, but it is " + std::to_string(limit));
+        }
+      }
+
+      // Empty statistics of nodes for the next query file
+      std::vector<NodeStatistics> node_statistics() const {
+        std::vector<NodeStatistics> statistics;
+        for (size_t node = 0; node < NODES.size(); ++node) {
+          statistics.push_back({node_threads(node), 0, 0, 0});
+        }
+        return statistics;
+      }
+
+      // Statistics of a finished query file become the statistics of the last query file
+      void publish(const IngestionStatistics &ingestion, const std::vector<NodeStatistics> &nodes, const CacheStatistics &cache) {
+        std::lock_guard<std::mutex> lock(STATISTICS_MUTEX);
+        INGESTION = ingestion;
+        NODE_STATISTICS = nodes;
+        CACHE_STATISTICS = cache;
+      }
+
+      // Find the group of the query and pad the query in the same way as the arena, returns nullptr if there is no such group
+      const FingerprintGroup *prepare(Query &query) {
+        auto group_it = KNOWLEDGE_BASE.find(query.KEY);
+        if (group_it == KNOWLEDGE_BASE.end()) {
+          return nullptr;
+        }
+        // Consideration that fingerprints have the same size, the query is padded in the same way as the arena.
+        query.FINGERPRINT.resize(group_it->second.stride(), '\0');
+        return &group_it->second;
+      }
+
+      // If the exact fingerprint has enough usable templates, no other fingerprint is needed
+      bool exact(const FingerprintGroup &group, const Query &query, const Siblings &excluded, Nearest &nearest) {
+        // LIMIT is positive, see check_limit()
+        size_t limit = LIMIT;
+        size_t exact = group.find(query.FINGERPRINT.data());
+        if (exact < group.size() && group.count(exact) >= limit) {
+          size_t templates = excluded.count(group, exact);
+          if (templates >= limit) {
+            nearest.add(0, exact, templates);
+            return true;
+          }
+        }
+        return false;
+      }
+
+      // Write results of query on the current element to the file.
+      // Output strongly reduced in comparison to C# version. Stats (if required) will be computed later.
+      void write(std::ostream &stream, int id, const FingerprintGroup *group, const Siblings &excluded, const std::vector<Neighbour> &neighbours) {
+        stream << id << '\n';
+        size_t count = 0;
+        for (auto neighbours_it = neighbours.begin(); neighbours_it != neighbours.end(); ++neighbours_it) {
+          uint32_t t;
+          for (Postings ids = group->ids(neighbours_it->second); ids.next(t); ) {
+            if (!excluded.contains(t)) {
+              ++count;
+              // Format: index of the element (to allow stats)  \t  distance
+              stream << t << '\t' << neighbours_it->first << '\n';
             }
+          }
+        }
+        // The group of the query can be in another shard
+        if (count == 0 && (group != nullptr || SHARDS == 1)) {
+          std::cerr << "No valid model was found for residue no. " << id << "!" << std::endl;
+        }
+        stream << '\n';
+      }
 
-            // Load fingerprint
-            char current = 0;
-            for (size_t i = 0; i < key.size(); i++) {
-              if (key[i] == '1') {
-                current += 1 << (i % 8);
+      // A single thread reads chunks of <size> queries ahead of workers, at most a queue full of chunks is kept in memory.
+      // If <buffer> is given, the reader takes chunks from it, so chunks cannot get too far ahead of written results.
+      // Read queries and chunks are counted in <ingestion>.
+      // NOTE: An exception is stored to <error> and the reading is stopped as if the file ended.
+      void readThread(QueryReader &reader, size_t size, common::multithread::ReorderBuffer *buffer, QueryQueue &queue, IngestionStatistics &ingestion, std::exception_ptr &error) {
+        size_t chunk = 0;
+        try {
+          while (buffer == nullptr || buffer->take(chunk)) {
+            std::vector<Query> queries(size);
+            size_t count = 0;
+            while (count < size && reader.next(queries[count])) {
+              ++count;
+            }
+            queries.resize(count);
+            ingestion.QUERIES += count;
+            if (count < size && buffer != nullptr) {
+              // The chunk is the last one, or there is no such chunk
+              buffer->close(count == 0 ? chunk : chunk + 1);
+            }
+            if (count == 0) {
+              break;
+            }
+            ++ingestion.CHUNKS;
+            queue.push(QueryChunk(chunk, std::move(queries)));
+            if (count < size) {
+              break;
+            }
+            if (buffer == nullptr) {
+              ++chunk;
+            }
+          }
+        } catch (...) {
+          error = std::current_exception();
+          if (buffer != nullptr) {
+            buffer->close(chunk);
+          }
+        }
+        queue.close();
+      }
+
+      // Threads take chunks of queries in their order, so a thread that got cheap queries (e.g. from small groups) simply takes more chunks
+      void selectThread(QueryQueue &queue, common::multithread::ReorderBuffer &buffer, NodeStatistics &statistics, CacheStatistics &cache) {
+        QueryChunk chunk;
+        // Found fingerprints of the current query
+        Nearest nearest(LIMIT);
+        std::vector<Neighbour> neighbours;
+        std::ostringstream stream;
+        std::string result;
+        while (queue.pop(chunk)) {
+          auto start = std::chrono::steady_clock::now();
+          stream.str(std::string());
+          for (auto queries_it = chunk.second.begin(); queries_it != chunk.second.end(); ++queries_it) {
+            Query &query = *queries_it;
+            Siblings excluded = siblings(query.ID);
+            const FingerprintGroup *group = prepare(query);
+            if (group == nullptr) {
+              neighbours.clear();
+            } else {
+              std::string key;
+              if (CACHE.enabled()) {
+                ++cache.LOOKUPS;
+              }
+              if (!CACHE.enabled() || !CACHE.find(key = cache_key(query), neighbours)) {
+                nearest.clear();
+                if (!exact(*group, query, excluded, nearest)) {
+                  ENGINES.at(query.KEY)->search(query.FINGERPRINT.data(), excluded, nearest);
+                }
+                nearest.result(neighbours);
+                if (CACHE.enabled()) {
+                  CACHE.insert(key, neighbours);
+                }
+              } else {
+                ++cache.HITS;
               }
-              if ((i & 7) == 7) {
-                fingerprint += current;
-                current = 0;
+            }
+            write(stream, query.ID, group, excluded, neighbours);
+          }
+          result = stream.str();
+          buffer.finish(chunk.first, result);
+          statistics.QUERIES += chunk.second.size();
+          statistics.MILLISECONDS += milliseconds(start);
+        }
+      }
+
+      // Queries of the same group are searched together in tiles of BATCH queries, so engines can share the work (e.g. a scan of the group).
+      // A thread of a node takes tiles of groups owned by the node (<round>.OWNED[node]) first, then it helps other nodes.
+      void batchThread(size_t node, Round &round, NodeStatistics &statistics) {
+        if (NODES.size() > 1) {
+          common::numa::pin(NODES[node]);
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::vector<const char*> fingerprints;
+        std::vector<Siblings> excluded;
+        std::vector<size_t> searched;
+        std::vector<Nearest> nearest;
+        Nearest single(LIMIT);
+        for (size_t step = 0; step < round.OWNED.size(); ++step) {
+          size_t list = (node + step) % round.OWNED.size();
+          for (size_t position = round.NEXT[list]++; position < round.OWNED[list].size(); position = round.NEXT[list]++) {
+            size_t tile = round.OWNED[list][position];
+            const FingerprintGroup &group = *round.TILES[tile].first;
+            const std::vector<size_t> &indices = round.TILES[tile].second;
+            statistics.QUERIES += indices.size();
+            if (step > 0) {
+              statistics.STOLEN += indices.size();
+            }
+            fingerprints.clear();
+            excluded.clear();
+            searched.clear();
+            for (auto indices_it = indices.begin(); indices_it != indices.end(); ++indices_it) {
+              const Query &query = round.QUERIES[*indices_it];
+              single.clear();
+              if (exact(group, query, siblings(query.ID), single)) {
+                single.result(round.RESULTS[*indices_it]);
+              } else {
+                fingerprints.push_back(query.FINGERPRINT.data());
+                excluded.push_back(siblings(query.ID));
+                searched.push_back(*indices_it);
               }
             }
-            size_t tail = key.size() % 8;
-            if (tail > 0) {
-              // Just aesthetic reasons to have fingerprint consistently compact form left to right
-              //current <<= (8-tail);
-              fingerprint += current;
+            if (searched.empty()) {
+              continue;
+            }
+            nearest.resize(searched.size(), Nearest(LIMIT));
+            for (auto nearest_it = nearest.begin(); nearest_it != nearest.end(); ++nearest_it) {
+              nearest_it->clear();
+            }
+            ENGINES.at(round.QUERIES[searched[0]].KEY)->search(searched.size(), fingerprints.data(), excluded.data(), nearest.data());
+            for (size_t i = 0; i < searched.size(); ++i) {
+              nearest[i].result(round.RESULTS[searched[i]]);
             }
-
-            // Create a key from features
-            key = create_key(features);
           }
+        }
+        statistics.MILLISECONDS += milliseconds(start);
+      }
 
-          //TODO: Short could be enough, but will be measurable difference in the effectivity?
-          std::map<int, std::vector<uint32_t> > distances;
+      // Queries are mined in rounds of ROUND queries, the next round is read while the current one is mined
+      void select_batch(QueryReader &reader, std::ostream &stream, IngestionStatistics &ingestion, std::vector<NodeStatistics> &nodes, CacheStatistics &cache) {
+        QueryQueue queue(1);
+        std::exception_ptr error;
+        std::thread thread(&Mine::readThread, this, std::ref(reader), ROUND, nullptr, std::ref(queue), std::ref(ingestion), std::ref(error));
+        QueryChunk chunk;
+        while (queue.pop(chunk)) {
+          Round round;
+          round.QUERIES.swap(chunk.second);
+          plan_round(round, cache);
+          std::vector<NodeStatistics> statistics(THREADS, NodeStatistics{0, 0, 0, 0});
+          std::vector<std::thread> threads;
+          for (size_t i = 0; i < THREADS; i++) {
+            threads.push_back(std::thread(&Mine::batchThread, this, i % NODES.size(), std::ref(round), std::ref(statistics[i])));
+          }
+          for (auto threads_it = threads.begin(); threads_it != threads.end(); ++threads_it) {
+            threads_it->join();
+          }
+          for (size_t i = 0; i < THREADS; i++) {
+            nodes[i % NODES.size()].add(statistics[i]);
+          }
+          finish_round(round, stream);
+        }
+        stream.flush();
+        thread.join();
+        ingestion.READER_STALLS = queue.full_stalls();
+        ingestion.WORKER_STALLS = queue.empty_stalls();
+        if (error) {
+          std::rethrow_exception(error);
+        }
+      }
 
-          auto group = KNOWLEDGE_BASE.find(key);
-          if (group != KNOWLEDGE_BASE.end()) {
-            auto templates_it = group->second.find(fingerprint);
-            //? 'templates = filter_siblings(id, templates)' create new instance of the output, so it is necessary to expand it into more complex branching?
-            //?   Or extract it into function, but it is also paid, right? How about inline functions, should be some marked as it?
-            if (templates_it != group->second.end() && templates_it->second.size() >= LIMIT) {
-              const std::vector<uint32_t> &templates = filter_siblings(id, templates_it->second);
-              if (templates.size() >= LIMIT) {
-                // TODO: A later filtering is useless for this branch.
-                //? Actually, how this works, does not it create new instances of inserted value, i.e. should be 'templates' deleted?
-                distances.insert({0, templates});
+      // Split queries of the round into tiles, cached and repeated queries are not searched
+      // Lookups of queries in CACHE are counted in <cache>
+      void plan_round(Round &round, CacheStatistics &cache) {
+        std::vector<Query> &queries = round.QUERIES;
+        round.GROUPS.assign(queries.size(), nullptr);
+        round.RESULTS.assign(queries.size(), std::vector<Neighbour>());
+        round.KEYS.assign(CACHE.enabled() ? queries.size() : 0, std::string());
+        round.CACHED.assign(queries.size(), false);
+        round.SAME.assign(queries.size(), queries.size());
+        {
+          std::unordered_map<std::string, size_t> open;
+          std::unordered_map<std::string, size_t> searched;
+          for (size_t i = 0; i < queries.size(); ++i) {
+            round.GROUPS[i] = prepare(queries[i]);
+            if (round.GROUPS[i] == nullptr) {
+              continue;
+            }
+            if (CACHE.enabled()) {
+              round.KEYS[i] = cache_key(queries[i]);
+              auto searched_it = searched.find(round.KEYS[i]);
+              if (searched_it != searched.end()) {
+                round.SAME[i] = searched_it->second;
+                ++cache.LOOKUPS;
+                ++cache.HITS;
+                continue;
               }
-            } 
-            if (distances.empty()) {
-              for (std::unordered_map<std::string, std::vector<uint32_t> >::iterator it = group->second.begin(); it != group->second.end(); it++) {
-                int distance = 0;
-                // Consideration that fingerprints have the same size.
-                for (size_t i = 0; i < fingerprint.length(); i++) {
-                  //? Does this retype affect effectivity?
-                  distance += DISTANCES[(unsigned char)(fingerprint[i] ^ it->first[i])];
-                }
-                std::vector<uint32_t>& list = distances[distance];
-                // TODO: It probably will be more effective to have vector of vectors instead of merging them?
-                list.insert(list.end(), it->second.begin(), it->second.end());
+              ++cache.LOOKUPS;
+              if ((round.CACHED[i] = CACHE.find(round.KEYS[i], round.RESULTS[i]))) {
+                ++cache.HITS;
+                continue;
               }
+              searched.insert({round.KEYS[i], i});
+            }
+            auto open_it = open.find(queries[i].KEY);
+            if (open_it == open.end() || round.TILES[open_it->second].second.size() >= BATCH) {
+              open[queries[i].KEY] = round.TILES.size();
+              round.TILES.push_back({round.GROUPS[i], std::vector<size_t>()});
+              open_it = open.find(queries[i].KEY);
             }
+            round.TILES[open_it->second].second.push_back(i);
           }
+        }
 
-          // Write results of query on the current element to the file.
-          // Output strongly reduced in comparison to C# version. Stats (if required) will be computed later.
-          stream << id << '\n';
-          size_t count = 0;
-          for (std::map<int, std::vector<uint32_t> >::iterator it = distances.begin(); count < LIMIT && it != distances.end(); it++) {
-            //? Does 'templates = filter_siblings(id, templates)' create new instance of the output, so it is necessary to use a new variable?
-            std::vector<uint32_t> templates = filter_siblings(id, it->second);
-            count += templates.size();
-            for (std::vector<uint32_t>::iterator i = templates.begin(); i != templates.end(); ++i) {
-              uint32_t t = *i;
-              // Format: index of the element (to allow stats)  \t  distance
-              stream << t << '\t' << it->first << '\n';
+        round.OWNED.assign(NODES.size(), std::vector<size_t>());
+        for (size_t tile = 0; tile < round.TILES.size(); ++tile) {
+          round.OWNED[NODES.size() > 1 ? OWNER.at(queries[round.TILES[tile].second[0]].KEY) : 0].push_back(tile);
+        }
+        round.NEXT.reset(new std::atomic<size_t>[NODES.size()]);
+        for (size_t node = 0; node < NODES.size(); ++node) {
+          round.NEXT[node] = 0;
+        }
+      }
+
+      // Cache results of the searched round and write results of all its queries
+      void finish_round(Round &round, std::ostream &stream) {
+        for (size_t i = 0; i < round.KEYS.size(); ++i) {
+          if (round.SAME[i] < round.QUERIES.size()) {
+            round.RESULTS[i] = round.RESULTS[round.SAME[i]];
+          } else if (round.GROUPS[i] != nullptr && !round.CACHED[i]) {
+            CACHE.insert(round.KEYS[i], round.RESULTS[i]);
+          }
+        }
+
+        for (size_t i = 0; i < round.QUERIES.size(); ++i) {
+          write(stream, round.QUERIES[i].ID, round.GROUPS[i], siblings(round.QUERIES[i].ID), round.RESULTS[i]);
+        }
+      }
+
+
+      // Map a precompiled image instead of parsing the knowledge-base
+      void open_image(const std::string &path) {
+        IMAGE.reset(new KnowledgeBaseImage(path));
+        if (IMAGE->filters() != FILTERS) {
+          std::string filters;
+          for (auto filters_it = IMAGE->filters().begin(); filters_it != IMAGE->filters().end(); ++filters_it) {
+            filters += (filters.empty() ? "" : std::string(1, common::filesystem::directory_separator)) + *filters_it;
+          }
+          throw common::exception::TitledException("The knowledge-base image '" + path + "' was compiled for central features '" + filters + "'");
+        }
+        KNOWLEDGE_BASE.swap(IMAGE->groups());
+        if (SHARDS > 1) {
+          // Groups of other shards are only mapped, so their pages are never read
+          std::map<std::string, uint64_t> sizes;
+          for (auto groups_it = KNOWLEDGE_BASE.begin(); groups_it != KNOWLEDGE_BASE.end(); ++groups_it) {
+            sizes[groups_it->first] = groups_it->second.ids_count();
+          }
+          const std::map<std::string, size_t> &shards = partition(sizes, SHARDS);
+          for (auto shards_it = shards.begin(); shards_it != shards.end(); ++shards_it) {
+            if (shards_it->second != SHARD) {
+              KNOWLEDGE_BASE.erase(shards_it->first);
             }
           }
-          if (count == 0) {
-            std::cerr << "No valid model was found for residue no. " << id << "!" << std::endl;
+        }
+        if (NODES.size() > 1) {
+          // Pages of the mapping are placed on the node that read them first, so groups are copied into the memory of their owners instead
+          std::map<std::string, uint64_t> sizes;
+          std::vector<std::string> names;
+          for (auto groups_it = KNOWLEDGE_BASE.begin(); groups_it != KNOWLEDGE_BASE.end(); ++groups_it) {
+            sizes[groups_it->first] = groups_it->second.ids_count();
+            names.push_back(groups_it->first);
           }
-          stream << std::endl;
+          assign_owners(sizes);
+          parallel_for_owners(names, [&](size_t i) {
+            FingerprintGroup &group = KNOWLEDGE_BASE.at(names[i]);
+            group = group.clone();
+          });
+          IMAGE.reset();
         }
-        stream.close();
       }
 
-
       public:
       // Load knowledge base in memory
+      // <knowledge_base> Root directory of a knowledge-base, or a precompiled image of a knowledge-base
       // <filters> Order of features for prefilter fingerprints according to central residue
-      Mine(std::string knowledge_base, const std::set<std::string> filters, char threads, int limit) : FILTERS(filters), THREADS(threads), LIMIT(limit) {
-        for (int i = 1; i < 256; i *= 2) {
-          for (int j = 0; j < i; j++) {
-            DISTANCES[i + j] = DISTANCES[j] + 1;
-          }
+      // <shard>, <shards> Load only groups assigned to the shard, see partition()
+      // <numa> Spread groups over NUMA nodes and pin threads of mining to nodes that own groups they search, see NODES
+      Mine(std::string knowledge_base, const std::set<std::string> filters, size_t threads, int limit, size_t shard = 0, size_t shards = 1, bool numa = false)
+          : THREADS(std::max(threads, (size_t)1)), LIMIT(limit), FILTERS(filters), ENGINE("scan"), TABLES(8), SHARD(shard), SHARDS(std::max(shards, (size_t)1)), CACHE(CACHE_ENTRIES), BATCH(1), INGESTION({"", 0, 0, 0, 0, 0}), CACHE_STATISTICS({0, 0}) {
+        check_limit(LIMIT);
+        if (SHARD >= SHARDS) {
+          throw common::exception::TitledException("Shard " + std::to_string(SHARD) + " does not exist, there are only " + std::to_string(SHARDS) + " shards");
         }
-
+        NODES = (numa ? common::numa::nodes() : std::vector<common::numa::Node>(1, common::numa::Node{0, std::vector<int>()}));
+        NODE_STATISTICS.assign(NODES.size(), NodeStatistics{0, 0, 0, 0});
+        auto start = std::chrono::steady_clock::now();
         // Basic check
         if (!common::filesystem::exists(knowledge_base)) {
           throw common::exception::TitledException("Path to the knowledge '" + knowledge_base + "' base does not exist");
         }
+        if (common::filesystem::is_regular_file(knowledge_base) && KnowledgeBaseImage::is_image(knowledge_base)) {
+          open_image(knowledge_base);
+          LOAD_MILLISECONDS = milliseconds(start);
+          TIMINGS.push_back({"image", knowledge_base, KNOWLEDGE_BASE.size(), LOAD_MILLISECONDS});
+          create_engines();
+          return;
+        }
         if (!common::filesystem::is_directory(knowledge_base)) {
           throw common::exception::TitledException("Path to the knowledge base '" + knowledge_base + "' is not a directory");
         }
 
-        // Previously loaded elements to reuse them in the case of recurrence and thus save RAM
-        std::unordered_set<std::string> fingerprints;
+        // Files of the knowledge-base and keys of their groups
+        std::vector<std::string> files;
+        std::vector<std::string> keys;
 
         // Iterate through knowledgebase files
         common::filesystem::RecursiveDirectoryFileIterator file_iterator(knowledge_base);
@@ -221,6 +697,7 @@ namespace inspire {
             std::string relative = common::filesystem::relative(file_iterator.filename(), knowledge_base);
             if (kb_path_check(std::string(1, common::filesystem::directory_separator) + relative, filters)) {
               // Processing of knowledgebase file
+              files.push_back(file_iterator.filename());
               relative.erase(relative.length() - 4);
 
               // Creating a key according to considered features (ordered by feature name to ensure unambiguity)
@@ -238,52 +715,196 @@ namespace inspire {
                   }
                 }
               }
-              const std::string& key_feature = create_key(features);
-
-              // Create and find group of fingerprints for the current file
-              std::unordered_map<std::string, std::unordered_map<std::string, std::vector<uint32_t> > >::iterator iterator = KNOWLEDGE_BASE.find(key_feature);
-              if (iterator == KNOWLEDGE_BASE.end()) {
-                KNOWLEDGE_BASE.insert({key_feature, std::unordered_map<std::string, std::vector<uint32_t> >()});
-              }
-              std::unordered_map<std::string, std::vector<uint32_t> >& group = KNOWLEDGE_BASE.at(key_feature);
-
-              // Read fingerprints from the current file
-              std::ifstream stream(file_iterator.filename(), std::ios::in | std::ios::binary);
-              if (stream.is_open()) {
-                uint32_t counter = 0;
-                uint32_t length;
-                stream.read(reinterpret_cast<char *>(&length), sizeof(length));
-                while (stream.peek() != EOF) {
-                  uint32_t id;
-                  stream.read(reinterpret_cast<char *>(&id), sizeof(id));
-                  //? Must be initialized for that size?
-                  std::string key_fingerprint(length, '\0');
-                  stream.read(&key_fingerprint[0], length);
-
-                  std::unordered_set<std::string>::iterator fp_iterator = fingerprints.find(key_fingerprint);
-                  if (fp_iterator == fingerprints.end()) {
-                    fingerprints.insert(key_fingerprint);
-                  } else {
-                    key_fingerprint = *fp_iterator;
-                  }
-
-                  std::unordered_map<std::string, std::vector<uint32_t> >::iterator kb_iterator = group.find(key_fingerprint);
-                  if (kb_iterator == group.end()) {
-                    //? How to initialize a vector with size 1? (e.g. in Java, the default initial size of List is 10, which is uneffective in the case most of Lists contain single item only and must be restricted explicit.)
-                    std::vector<uint32_t> tmp;
-                    tmp.push_back(id);
-                    group.insert({key_fingerprint, tmp});
-                  } else {
-                    kb_iterator->second.push_back(id);
-                  }
-                  counter++;
-                }
-              }
+              keys.push_back(create_key(features));
             }
           } while (file_iterator.has_next());
         } else {
           throw common::exception::TitledException("There is no file in the directory '" + knowledge_base + "'");
         }
+
+        if (SHARDS > 1) {
+          std::map<std::string, uint64_t> sizes;
+          for (size_t i = 0; i < files.size(); ++i) {
+            sizes[keys[i]] += common::filesystem::file_size(files[i]);
+          }
+          const std::map<std::string, size_t> &shards = partition(sizes, SHARDS);
+          size_t kept = 0;
+          for (size_t i = 0; i < files.size(); ++i) {
+            if (shards.at(keys[i]) == SHARD) {
+              files[kept] = files[i];
+              keys[kept] = keys[i];
+              ++kept;
+            }
+          }
+          files.resize(kept);
+          keys.resize(kept);
+        }
+
+        // Entries removed by updates of the knowledge-base are not loaded
+        IdRanges tombstones = load_tombstones(common::filesystem::enclose_directory_name(knowledge_base) + TOMBSTONES_FILE());
+        Siblings removed(&tombstones);
+
+        // Files are read in parallel, each into its own builder, and the builders are merged in the order of files afterwards
+        std::vector<FingerprintGroupBuilder> file_builders(files.size());
+        std::vector<char> read(files.size());
+        TIMINGS.resize(files.size());
+        common::multithread::parallel_for(files.size(), THREADS, [&](size_t i) {
+          auto file_start = std::chrono::steady_clock::now();
+          read[i] = load_file(files[i], removed, file_builders[i]);
+          TIMINGS[i] = {"file", files[i], file_builders[i].size(), milliseconds(file_start)};
+        });
+
+        // Raw records of individual groups, they are packed into KNOWLEDGE_BASE when all files are read
+        std::unordered_map<std::string, FingerprintGroupBuilder> builders;
+        std::vector<std::string> names;
+        for (size_t i = 0; i < files.size(); ++i) {
+          auto builders_it = builders.find(keys[i]);
+          if (builders_it == builders.end()) {
+            builders_it = builders.emplace(keys[i], FingerprintGroupBuilder()).first;
+            names.push_back(keys[i]);
+          }
+          if (read[i]) {
+            builders_it->second.append(file_builders[i]);
+          }
+        }
+        std::vector<FingerprintGroupBuilder>().swap(file_builders);
+
+        // Groups are deduplicated and packed in parallel too, each on the node that owns it
+        std::map<std::string, uint64_t> sizes;
+        for (auto builders_it = builders.begin(); builders_it != builders.end(); ++builders_it) {
+          sizes[builders_it->first] = builders_it->second.size();
+        }
+        assign_owners(sizes);
+        std::vector<FingerprintGroup> groups(names.size());
+        TIMINGS.resize(files.size() + names.size());
+        parallel_for_owners(names, [&](size_t i) {
+          auto group_start = std::chrono::steady_clock::now();
+          groups[i] = builders.at(names[i]).build();
+          TIMINGS[files.size() + i] = {"group", names[i], groups[i].size(), milliseconds(group_start)};
+        });
+        for (size_t i = 0; i < names.size(); ++i) {
+          KNOWLEDGE_BASE.emplace(names[i], std::move(groups[i]));
+        }
+        LOAD_MILLISECONDS = milliseconds(start);
+        create_engines();
+      }
+
+      // Load intervals of identifiers removed from a knowledge-base, a missing file means that nothing was removed
+      static IdRanges load_tombstones(const std::string &path) {
+        IdRanges ranges;
+        std::ifstream stream(path);
+        std::string line;
+        while (std::getline(stream, line)) {
+          std::stringstream parts(line);
+          std::string protein;
+          uint32_t first;
+          uint32_t last;
+          if (std::getline(parts, protein, '\t') && parts >> first >> last && first <= last) {
+            ranges.push_back({first, last});
+          }
+        }
+        // Merge overlapping and adjacent intervals
+        std::sort(ranges.begin(), ranges.end());
+        size_t count = 0;
+        for (auto ranges_it = ranges.begin(); ranges_it != ranges.end(); ++ranges_it) {
+          if (count > 0 && ranges_it->first <= ranges[count-1].second + (uint64_t)1) {
+            ranges[count-1].second = std::max(ranges[count-1].second, ranges_it->second);
+          } else {
+            ranges[count++] = *ranges_it;
+          }
+        }
+        ranges.resize(count);
+        return ranges;
+      }
+
+      // Assign groups to shards, so shards have similar sizes: the largest groups are assigned first, each to the smallest shard.
+      // A group is never split, thus all fingerprints that can be found for a query are in a single shard.
+      // <sizes> Size of each group (in any unit)
+      static std::map<std::string, size_t> partition(const std::map<std::string, uint64_t> &sizes, size_t shards) {
+        std::vector<std::pair<uint64_t, std::string> > groups;
+        for (auto sizes_it = sizes.begin(); sizes_it != sizes.end(); ++sizes_it) {
+          groups.push_back({sizes_it->second, sizes_it->first});
+        }
+        std::sort(groups.begin(), groups.end(), [](const std::pair<uint64_t, std::string> &left, const std::pair<uint64_t, std::string> &right) {
+          return left.first > right.first || (left.first == right.first && left.second < right.second);
+        });
+        std::vector<uint64_t> loads(std::max(shards, (size_t)1), 0);
+        std::map<std::string, size_t> result;
+        for (auto groups_it = groups.begin(); groups_it != groups.end(); ++groups_it) {
+          size_t smallest = std::min_element(loads.begin(), loads.end()) - loads.begin();
+          loads[smallest] += groups_it->first;
+          result[groups_it->second] = smallest;
+        }
+        return result;
+      }
+
+      // Combine results of shards of a knowledge-base into the result of the whole knowledge-base.
+      // All <inputs> must be created for the same query file, for each query at most one of them has a non-empty result.
+      static void merge(const std::vector<std::string> &inputs, const std::string &output) {
+        std::vector<std::unique_ptr<std::ifstream> > streams;
+        for (auto inputs_it = inputs.begin(); inputs_it != inputs.end(); ++inputs_it) {
+          streams.emplace_back(new std::ifstream(*inputs_it));
+          if (!streams.back()->is_open()) {
+            throw common::exception::TitledException("It is not possible to open the partial result '" + *inputs_it + "'");
+          }
+        }
+        std::ofstream stream(output);
+        std::string id;
+        std::string line;
+        std::string result;
+        while (!streams.empty() && std::getline(*streams[0], id)) {
+          result.clear();
+          size_t found = 0;
+          for (size_t i = 0; i < streams.size(); ++i) {
+            if (i > 0 && (!std::getline(*streams[i], line) || line != id)) {
+              throw common::exception::TitledException("The partial result '" + inputs[i] + "' does not correspond to the partial result '" + inputs[0] + "'");
+            }
+            size_t size = result.size();
+            while (std::getline(*streams[i], line) && !line.empty()) {
+              result += line;
+              result += '\n';
+            }
+            if (result.size() > size && ++found > 1) {
+              throw common::exception::TitledException("Multiple partial results for residue no. " + id + ", the shards overlap");
+            }
+          }
+          if (result.empty()) {
+            std::cerr << "No valid model was found for residue no. " << id << "!" << std::endl;
+          }
+          stream << id << '\n' << result << '\n';
+        }
+        for (size_t i = 1; i < streams.size(); ++i) {
+          if (std::getline(*streams[i], line)) {
+            throw common::exception::TitledException("The partial result '" + inputs[i] + "' does not correspond to the partial result '" + inputs[0] + "'");
+          }
+        }
+      }
+
+      // Store the loaded knowledge-base as an image that can be later used instead of the knowledge-base's directory
+      void compile(const std::string &path) {
+        KnowledgeBaseImage::write(path, FILTERS, KNOWLEDGE_BASE);
+      }
+
+      // Write how long it took to read individual files and to pack individual groups of the knowledge-base as tab-separated values
+      // NOTE: Files and groups are processed in parallel, so the times do not sum up to the total time.
+      void timings(std::ostream &stream) const {
+        stream << "kind\tname\tcount\tmilliseconds\n";
+        for (auto timings_it = TIMINGS.begin(); timings_it != TIMINGS.end(); ++timings_it) {
+          stream << timings_it->KIND << '\t' << timings_it->NAME << '\t' << timings_it->COUNT << '\t' << timings_it->MILLISECONDS << '\n';
+        }
+        stream << "total\t\t" << KNOWLEDGE_BASE.size() << '\t' << LOAD_MILLISECONDS << '\n';
+      }
+
+      // Check whether an image exists and was compiled for the given features of central residues
+      static bool has_image(const std::string &path, const std::set<std::string> &filters) {
+        if (!common::filesystem::is_regular_file(path) || !KnowledgeBaseImage::is_image(path)) {
+          return false;
+        }
+        try {
+          return KnowledgeBaseImage(path).filters() == filters;
+        } catch (const common::exception::TitledException&) {
+          return false;
+        }
       }
 
       // Load what entries should be skipped for particular queries
@@ -295,12 +916,19 @@ namespace inspire {
             size_t tab = line.find('\t');
             if (tab >= 0) {
               std::stringstream values(line.substr(tab+1));
-              std::unordered_set<int>* exclude = new std::unordered_set<int>(std::istream_iterator<int>(values), std::istream_iterator<int>());
-              std::stringstream keys(line.substr(0, tab));
+              std::vector<uint32_t> ids;
               int id;
+              while (values >> id) {
+                // Negative identifiers cannot be in a knowledge-base
+                if (id >= 0) {
+                  ids.push_back(id);
+                }
+              }
+              EXCLUDES.push_back(make_ranges(ids));
+              EXCLUDE_KEYS.push_back(QueryCache::excluded(EXCLUDES.back()));
+              std::stringstream keys(line.substr(0, tab));
               while (keys >> id) {
-                //? Should be 'exclude' deleted, i.e. is it created new in 'EXCLUDE', or copied?
-                EXCLUDE.insert({id, exclude});
+                EXCLUDE.insert({id, EXCLUDES.size() - 1});
               }
             }
           }
@@ -308,25 +936,144 @@ namespace inspire {
       }
 
       void clear_excludes() {
-        for (auto exclude_it = EXCLUDE.begin(); exclude_it != EXCLUDE.end(); ++exclude_it) {
-          delete exclude_it->second;
-        }
         EXCLUDE.clear();
+        EXCLUDES.clear();
+        EXCLUDE_KEYS.clear();
       }
 
-      void threads(char threads) {
-        THREADS = threads;
+      void threads(size_t threads) {
+        THREADS = std::max(threads, (size_t)1);
       }
 
       void limit(int limit) {
+        check_limit(limit);
         LIMIT = limit;
       }
 
-      void select(std::string input, std::string output) {
+      void batch(size_t batch) {
+        BATCH = std::max(batch, (size_t)1);
+      }
+
+      // Select how the most similar fingerprints are searched, i.e. 'scan' (compare with all fingerprints), 'mih' (multi-index hashing),
+      // 'pivot' (pruning by distances from pivots) or 'lsh' (approximate locality-sensitive hashing)
+      void engine(const std::string &engine) {
+        if (engine != ENGINE) {
+          std::unique_ptr<SearchEngine> test(create_engine(engine, FingerprintGroup()));
+          // Results of exact engines are the same
+          if (ENGINE == "lsh" || engine == "lsh") {
+            CACHE.clear();
+          }
+          ENGINE = engine;
+          create_engines();
+        }
+      }
+
+      // Number of hash tables of the approximate engine, more tables mean a higher recall and a slower search
+      void tables(size_t tables) {
+        tables = std::max(tables, (size_t)1);
+        if (tables != TABLES) {
+          TABLES = tables;
+          if (ENGINE == "lsh") {
+            CACHE.clear();
+            create_engines();
+          }
+        }
+      }
+
+      // Compare the current engine with the exact scan on a random sample of at most <sample> queries from <input>
+      // and write the mean recall@k (k being the number of mined elements) and times of both searches as tab-separated values.
+      // Recall of a query is the fraction of its k nearest templates that were found, templates with the same distance as the k-th one are interchangeable.
+      void evaluate(const std::string &input, size_t sample, std::ostream &stream) {
+        // Reservoir sampling with a fixed seed, so the same queries are evaluated every time
+        std::vector<Query> queries;
+        {
+          QueryReader reader(input, FILTERS);
+          std::mt19937 random(5489u);
+          Query query;
+          for (size_t read = 0; reader.next(query); ++read) {
+            if (queries.size() < sample) {
+              queries.push_back(query);
+            } else {
+              size_t index = random() % (read + 1);
+              if (index < sample) {
+                queries[index] = query;
+              }
+            }
+          }
+        }
+
+        std::unordered_map<std::string, std::unique_ptr<SearchEngine> > scans;
+        Nearest nearest(LIMIT);
+        std::vector<Neighbour> neighbours;
+        std::vector<int> exact_distances;
+        std::vector<int> engine_distances;
+        double exact_milliseconds = 0;
+        double engine_milliseconds = 0;
+        double recall = 0;
+        // Sizes of groups of evaluated queries and numbers of fingerprints compared by both searches
+        double fingerprints = 0;
+        double exact_compared = 0;
+        double engine_compared = 0;
+        size_t evaluated = 0;
+        for (auto queries_it = queries.begin(); queries_it != queries.end(); ++queries_it) {
+          const FingerprintGroup *group = prepare(*queries_it);
+          if (group == nullptr) {
+            continue;
+          }
+          std::unique_ptr<SearchEngine> &scan = scans[queries_it->KEY];
+          if (!scan) {
+            scan.reset(create_engine("scan", *group));
+          }
+          Siblings excluded = siblings(queries_it->ID);
+          size_t compared[2] = {0, 0};
+          for (int engine = 0; engine < 2; ++engine) {
+            const SearchEngine *current = (engine == 0 ? scan.get() : ENGINES.at(queries_it->KEY).get());
+            uint64_t before = current->compared();
+            auto start = std::chrono::steady_clock::now();
+            nearest.clear();
+            if (!exact(*group, *queries_it, excluded, nearest)) {
+              current->search(queries_it->FINGERPRINT.data(), excluded, nearest);
+            }
+            nearest.result(neighbours);
+            (engine == 0 ? exact_milliseconds : engine_milliseconds) += milliseconds(start);
+            compared[engine] = current->compared() - before;
+            // Distance of each usable template in the order of the output
+            std::vector<int> &distances = (engine == 0 ? exact_distances : engine_distances);
+            distances.clear();
+            for (auto neighbours_it = neighbours.begin(); neighbours_it != neighbours.end(); ++neighbours_it) {
+              uint32_t t;
+              for (Postings ids = group->ids(neighbours_it->second); ids.next(t); ) {
+                if (!excluded.contains(t)) {
+                  distances.push_back(neighbours_it->first);
+                }
+              }
+            }
+          }
+          size_t k = std::min((size_t)std::max(LIMIT, 1), exact_distances.size());
+          if (k == 0) {
+            continue;
+          }
+          int bound = exact_distances[k - 1];
+          size_t found = std::upper_bound(engine_distances.begin(), engine_distances.end(), bound) - engine_distances.begin();
+          recall += (double)std::min(found, k) / k;
+          fingerprints += group->size();
+          exact_compared += compared[0];
+          engine_compared += compared[1];
+          ++evaluated;
+        }
+        size_t divisor = std::max(evaluated, (size_t)1);
+        stream << "engine\tqueries\tk\trecall\texact_milliseconds\tengine_milliseconds\tfingerprints\texact_compared\tengine_compared\n";
+        stream << ENGINE << '\t' << evaluated << '\t' << LIMIT << '\t' << (evaluated == 0 ? 1.0 : recall / evaluated) << '\t'
+               << exact_milliseconds << '\t' << engine_milliseconds << '\t'
+               << fingerprints / divisor << '\t' << exact_compared / divisor << '\t' << engine_compared / divisor << '\n';
+      }
+
+      // Base name of the output file (without '.med' extension) for a query file
+      static std::string output_name(const std::string &input, std::string output) {
         if (output.empty() || output.back() == common::filesystem::directory_separator) {
           size_t i = input.rfind(common::filesystem::directory_separator);
           std::string tmp = (i == input.npos ? input : input.substr(i+1));
-          if (common::string::ends_with(tmp, ".fit")) {
+          if (common::string::ends_with(tmp, ".fit") || common::string::ends_with(tmp, ".fiq")) {
             output += tmp.substr(0, tmp.size()-4);
           } else {
             output += tmp;
@@ -334,28 +1081,126 @@ namespace inspire {
         } else if (common::string::ends_with(output, ".med")) {
           output = output.substr(0, output.size()-4);
         }
-        load_tasks(input);
+        return output;
+      }
+
+      // NOTE: Several query files can be mined at once from different threads, but the mine must not be reconfigured meanwhile.
+      void select(std::string input, std::string output) {
+        output = output_name(input, output);
+        std::ifstream queries(input, std::ios::in | std::ios::binary);
+        std::ofstream stream(output + ".med");
+        select(queries, stream, input);
+        stream.close();
+      }
+
+      // Mine queries read from <queries>, e.g. from fingerprints kept in memory, and write results into <stream>
+      // <input> Name of the queries in statistics and error messages
+      void select(std::istream &queries, std::ostream &stream, const std::string &input) {
+        auto start = std::chrono::steady_clock::now();
+        IngestionStatistics ingestion = {input, 0, 0, 0, 0, 0};
+        std::vector<NodeStatistics> nodes = node_statistics();
+        CacheStatistics cache = {0, 0};
+        QueryReader reader(queries, FILTERS, input);
+        // Queries must be dispatched to nodes by their groups, which is done for whole rounds of queries
+        if (BATCH > 1 || NODES.size() > 1) {
+          select_batch(reader, stream, ingestion, nodes, cache);
+          ingestion.MILLISECONDS = milliseconds(start);
+          publish(ingestion, nodes, cache);
+          save_cache();
+          return;
+        }
 
-        std::map<std::string, std::thread> threads;
+        // Results are written by this thread as soon as all previous chunks are finished, a few chunks per thread can wait in the buffer,
+        // so the memory does not depend on the size of the query file
+        common::multithread::ReorderBuffer buffer(4 * THREADS);
+        QueryQueue queue(2 * THREADS);
+        std::exception_ptr error;
+        std::thread reader_thread(&Mine::readThread, this, std::ref(reader), CHUNK, &buffer, std::ref(queue), std::ref(ingestion), std::ref(error));
+        std::vector<std::thread> threads;
+        std::vector<NodeStatistics> statistics(THREADS, NodeStatistics{0, 0, 0, 0});
+        std::vector<CacheStatistics> lookups(THREADS, CacheStatistics{0, 0});
         for (size_t i = 0; i < THREADS; i++) {
-          std::string temp = output + "." + std::to_string(i) + ".med";
-          threads[temp] = std::thread(&Mine::selectThread, this, temp);
+          threads.push_back(std::thread(&Mine::selectThread, this, std::ref(queue), std::ref(buffer), std::ref(statistics[i]), std::ref(lookups[i])));
         }
+        std::string result;
+        while (buffer.next(result)) {
+          stream << result;
+        }
+        stream.flush();
+        reader_thread.join();
         for (auto threads_it = threads.begin(); threads_it != threads.end(); ++threads_it) {
-          threads_it->second.join();
-        }
-        if (threads.size() >= 1) {
-          common::filesystem::move(threads.begin()->first, output + ".med");
-          if (threads.size() > 1) {
-            std::ofstream out(output + ".med", std::ios_base::binary | std::ios_base::app);
-            for (auto threads_it = ++threads.begin(); threads_it != threads.end(); ++threads_it) {
-              std::ifstream in(threads_it->first, std::ios_base::binary);
-              out << in.rdbuf();
-              in.close();
-              common::filesystem::remove_file(threads_it->first);
-            }
-            out.close();
-          }
+          threads_it->join();
+        }
+        // There is a single node only
+        for (size_t i = 0; i < THREADS; i++) {
+          nodes[0].add(statistics[i]);
+          cache.add(lookups[i]);
+        }
+        ingestion.READER_STALLS = queue.full_stalls();
+        ingestion.WORKER_STALLS = queue.empty_stalls();
+        ingestion.MILLISECONDS = milliseconds(start);
+        publish(ingestion, nodes, cache);
+        if (error) {
+          std::rethrow_exception(error);
+        }
+        save_cache();
+      }
+
+      // Maximal number of cached results of queries, 0 disables the cache; all cached results are dropped
+      void cache(size_t entries) {
+        CACHE.capacity(entries);
+      }
+
+      // Load cached results of queries from a file stored for the same knowledge-base and engine (if it exists),
+      // and store all cached results into the file after each query file
+      void cache_file(const std::string &path) {
+        CACHE_FILE = path;
+        if (common::filesystem::exists(path) && !CACHE.load(path, signature())) {
+          std::cerr << "The result cache '" << path << "' was stored for another knowledge-base or engine, it will be replaced" << std::endl;
+        }
+      }
+
+      // Store the cache into its file, if there is any
+      void save_cache() {
+        if (!CACHE_FILE.empty()) {
+          CACHE.save(CACHE_FILE, signature());
+        }
+      }
+
+      // Write how many queries of the last query file were found in the cache of results as tab-separated values
+      void cache_statistics(std::ostream &stream) const {
+        stream << "input\tlookups\thits\thit_rate\tentries\tloaded\n";
+        std::lock_guard<std::mutex> lock(STATISTICS_MUTEX);
+        stream << INGESTION.INPUT << '\t' << CACHE_STATISTICS.LOOKUPS << '\t' << CACHE_STATISTICS.HITS << '\t'
+               << (CACHE_STATISTICS.LOOKUPS == 0 ? 0.0 : (double)CACHE_STATISTICS.HITS / CACHE_STATISTICS.LOOKUPS) << '\t' << CACHE.size() << '\t' << CACHE.loaded() << '\n';
+      }
+
+      // Write how queries of the last query file were read as tab-separated values
+      void ingestion(std::ostream &stream) const {
+        stream << "input\tqueries\tchunks\treader_stalls\tworker_stalls\tmilliseconds\n";
+        std::lock_guard<std::mutex> lock(STATISTICS_MUTEX);
+        stream << INGESTION.INPUT << '\t' << INGESTION.QUERIES << '\t' << INGESTION.CHUNKS << '\t'
+               << INGESTION.READER_STALLS << '\t' << INGESTION.WORKER_STALLS << '\t' << INGESTION.MILLISECONDS << '\n';
+      }
+
+      // Write how groups of the knowledge-base are placed on NUMA nodes and how threads of individual nodes mined the last query file
+      // as tab-separated values; stolen queries are queries of groups owned by another node
+      void numa(std::ostream &stream) const {
+        std::vector<size_t> groups(NODES.size(), 0);
+        std::vector<size_t> fingerprints(NODES.size(), 0);
+        for (auto groups_it = KNOWLEDGE_BASE.begin(); groups_it != KNOWLEDGE_BASE.end(); ++groups_it) {
+          size_t node = (NODES.size() > 1 ? OWNER.at(groups_it->first) : 0);
+          ++groups[node];
+          fingerprints[node] += groups_it->second.size();
+        }
+        stream << "node\tcpus\tgroups\tfingerprints\tthreads\tqueries\tstolen\tmilliseconds\tqueries_per_second\n";
+        std::lock_guard<std::mutex> lock(STATISTICS_MUTEX);
+        for (size_t node = 0; node < NODES.size(); ++node) {
+          const NodeStatistics &statistics = NODE_STATISTICS[node];
+          // Throughput of all threads of the node, i.e. of their mean time of mining
+          double throughput = (statistics.MILLISECONDS > 0 ? statistics.QUERIES * 1000.0 * statistics.THREADS / statistics.MILLISECONDS : 0);
+          stream << NODES[node].ID << '\t' << NODES[node].CPUS.size() << '\t' << groups[node] << '\t' << fingerprints[node] << '\t'
+                 << statistics.THREADS << '\t' << statistics.QUERIES << '\t' << statistics.STOLEN << '\t' << statistics.MILLISECONDS << '\t' << throughput << '\n';
         }
       }
 
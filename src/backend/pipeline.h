@@ -0,0 +1,256 @@
+#pragma once
+
+#include "index.h"
+#include "features.h"
+#include "subgraphs.h"
+#include "fingerprints.h"
+#include "mine.h"
+#include "classify.h"
+#include "predict.h"
+#include "assign.h"
+#include "../common/filesystem.h"
+#include "../common/string.h"
+#ifdef FREESASA
+#include "../common/sasa.h"
+#endif // FREESASA
+#include <memory>
+
+namespace inspire {
+  namespace backend {
+    // Prediction stages of inspire with everything read from a knowledge-base kept in memory,
+    // so that a single process can serve many prediction jobs without reloading the knowledge-base.
+    // The index, features and subgraphs of a job are stored in its own temporary directory, hence jobs can run in parallel,
+    // while fingerprints and all later results are passed between stages in memory.
+    class Pipeline {
+      private:
+      const std::string KNOWLEDGE_BASE;
+      // Where temporary directories of individual jobs are created
+      const std::string TEMP_DIR;
+      // Switchers of optional features read from the configuration file
+      std::vector<std::string> FEATURES;
+      // Definitions of nodes and edges of subgraphs read from the configuration file
+      std::string NODES;
+      std::string EDGES;
+      // Features of central residues
+      std::set<std::string> FILTERS;
+      std::unique_ptr<Mine> MINE;
+      std::unique_ptr<Classifier> CLASSIFIER;
+      std::unique_ptr<Predictor> PREDICTOR;
+
+      static std::string next_line(std::istream &config, const std::string &name) {
+        std::string line;
+        if (!std::getline(config, line)) {
+          throw common::exception::TitledException("Unexpected end of the configuration file '" + name + "'.");
+        }
+        return line;
+      }
+
+      // Create optional features in the same way as inspire does in the prediction mode
+      void create_features(ProteinIterator* it, std::vector<Feature<std::string>*> &features, std::vector<IFeature*> &inner_features) {
+        for (auto features_it = FEATURES.begin(); features_it != FEATURES.end(); ++features_it) {
+          if (*features_it == "-a") {
+            Feature<std::string>* subfeature = new AminoacidFeature(it);
+            inner_features.push_back(subfeature);
+            features.push_back(new StringProjectionFeature(KNOWLEDGE_BASE + "aminoacid.nor", subfeature));
+          } else if (*features_it == "-e") {
+            features.push_back(new CompositionFeature(it));
+#ifdef FREESASA
+          } else if (*features_it == "-r") {
+            Feature<float>* subfeature = new common::sasa::SasaFeature(it, KNOWLEDGE_BASE + "rasa.rus", KNOWLEDGE_BASE + "composition.cop");
+            inner_features.push_back(subfeature);
+            Feature<std::string>* classes = new AminoacidFeature(it);
+            inner_features.push_back(classes);
+            subfeature = new RelativeAminoacidFeature(subfeature, classes, KNOWLEDGE_BASE + "reference.sas");
+            inner_features.push_back(subfeature);
+            features.push_back(new ToStringFeature<float>(subfeature));
+#endif // FREESASA
+          } else if (*features_it == "-t") {
+            Feature<float>* subfeature = new TemperatureFeature(it);
+            inner_features.push_back(subfeature);
+            features.push_back(new ToStringFeature<float>(subfeature));
+          }
+        }
+      }
+
+      // Extract subgraphs according to a definition from the configuration file and return the name of the created file
+      static std::string subgraphs(ChainSubgraphs &subgraphs, const std::string &definition, bool nodes) {
+        if (definition.empty()) {
+          return subgraphs.k_nearest(0);
+        }
+        switch (definition[0]) {
+          case 'c':
+            return subgraphs.k_nearest(definition.size() > 1 ? std::stoi(definition.substr(1)) : (nodes ? 15 : 6));
+          case 'd':
+            return subgraphs.distance_limit(definition.size() > 1 ? std::stof(definition.substr(1)) : (nodes ? 12.0 : 6.0));
+          case 'e':
+            if (definition.size() > 1) {
+              size_t index = definition.find('-', 2);
+              if (index == definition.npos || index == definition.size()-1) {
+                return subgraphs.edge_limit(std::stof(definition.substr(1, index-1)), nodes ? 2 : 1);
+              }
+              return subgraphs.edge_limit(std::stof(definition.substr(1, index-1)), std::stoi(definition.substr(index+1)));
+            }
+            return subgraphs.edge_limit(6.0, nodes ? 2 : 1);
+          default:
+            throw common::exception::TitledException("Unknown " + std::string(nodes ? "nodes" : "edges") + " identifier '" + definition + "'.");
+        }
+      }
+
+      public:
+      // Read the configuration and load the knowledge-base
+      // <knowledge_base> Directory created by inspire in the construction mode
+      // <temp_dir> Where temporary directories of individual jobs are created
+      // <thresholds> Thresholds of FractionalPredictor
+      Pipeline(const std::string &knowledge_base, const std::string &temp_dir, size_t threads, int limit, const std::string &thresholds)
+          : KNOWLEDGE_BASE(common::filesystem::enclose_directory_name(knowledge_base)), TEMP_DIR(temp_dir) {
+        std::string config_name = KNOWLEDGE_BASE + "config";
+        std::ifstream config(config_name);
+        if (!config.is_open()) {
+          throw common::exception::TitledException("It is not possible to open configuration file '" + config_name + "'.");
+        }
+        // Iterator and distance of interfaces are used only during the construction of a knowledge-base
+        next_line(config, config_name);
+        next_line(config, config_name);
+        std::string line;
+        while ((line = next_line(config, config_name)) != "--") {
+          if (line == "-a" || line == "-e" || line == "-t"
+#ifdef FREESASA
+              || line == "-r"
+#endif // FREESASA
+              ) {
+            FEATURES.push_back(line);
+          } else {
+            // External features are asked for on the standard input that a server does not have
+            throw common::exception::TitledException("Unsupported line '" + line + "' in the configuration file '" + config_name + "'.");
+          }
+        }
+        NODES = next_line(config, config_name);
+        EDGES = next_line(config, config_name);
+
+        ExplicitIterator it;
+        std::vector<Feature<std::string>*> features;
+        std::vector<IFeature*> inner_features;
+        create_features(&it, features, inner_features);
+        for (auto features_it = features.begin(); features_it != features.end(); ++features_it) {
+          FILTERS.emplace((*features_it)->title());
+          delete *features_it;
+        }
+        for (auto features_it = inner_features.begin(); features_it != inner_features.end(); ++features_it) {
+          delete *features_it;
+        }
+
+        std::string image_name = KNOWLEDGE_BASE + "fingerprints.fim";
+        MINE.reset(new Mine(Mine::has_image(image_name, FILTERS) ? image_name : KNOWLEDGE_BASE, FILTERS, threads, limit));
+        CLASSIFIER.reset(new Classifier(KNOWLEDGE_BASE + "interfaces.tur"));
+        PREDICTOR.reset(new FractionalPredictor(thresholds));
+      }
+
+      Mine &mine() {
+        return *MINE;
+      }
+
+      // Predict interfaces of given structures and return the content of the output file
+      // <format> 'c' for delimiter-separated values, 'l' for the aligned list, or 'x' for XML
+      // NOTE: The method can be called from several threads, as the mine counts statistics of each query file apart
+      //       and the classifier and the predictor are only read, but the mine must not be reconfigured meanwhile.
+      std::string predict(const std::vector<std::string> &structures, char format = 'c', char delimiter = '\t') {
+        for (auto structures_it = structures.begin(); structures_it != structures.end(); ++structures_it) {
+          if (!common::filesystem::exists(*structures_it)) {
+            throw common::exception::TitledException("Structure '" + *structures_it + "' does not exist.");
+          }
+        }
+        std::string temp_dir;
+        for (size_t i = 0; i < 10 && temp_dir.empty(); i++) {
+          std::string tmp = TEMP_DIR + common::filesystem::unique_name();
+          if (common::filesystem::create_directory_recursive(tmp)) {
+            temp_dir = common::filesystem::enclose_directory_name(tmp);
+          }
+        }
+        if (temp_dir.empty()) {
+          throw common::exception::TitledException("It is not possible to create unique temporary directory.");
+        }
+        try {
+          std::string index_name = temp_dir + "residues.ind";
+          std::string coordinates_name = temp_dir + "coordinates.tur";
+          std::string features_name = temp_dir + "features.tur";
+          std::string nodes_name = temp_dir + "nodes.sup";
+          std::string edges_name = temp_dir + "edges.sup";
+          // Names of results kept in memory used in statistics and error messages
+          std::string query_name = temp_dir + "fingerprints";
+          std::string statistics_name = temp_dir + "ratios";
+          {
+            ExplicitIterator it;
+            BasicFilter filter;
+            {
+              Indexer indexer(index_name, &it, &filter);
+              for (auto structures_it = structures.begin(); structures_it != structures.end(); ++structures_it) {
+                indexer.process(*structures_it);
+              }
+            }
+            Features extractor(index_name, &it, &filter);
+            for (auto structures_it = structures.begin(); structures_it != structures.end(); ++structures_it) {
+              extractor.index_pdb(*structures_it);
+            }
+            std::vector<Feature<std::string>*> features;
+            features.push_back(new CoordinateFeature(&it));
+            extractor.extract_features(coordinates_name, features);
+            delete features.back();
+            features.clear();
+            std::vector<IFeature*> inner_features;
+            create_features(&it, features, inner_features);
+            extractor.extract_features(features_name, features);
+            for (auto features_it = features.begin(); features_it != features.end(); ++features_it) {
+              delete *features_it;
+            }
+            for (auto features_it = inner_features.begin(); features_it != inner_features.end(); ++features_it) {
+              delete *features_it;
+            }
+          }
+          {
+            ChainSubgraphs chain(index_name, coordinates_name, temp_dir + "subgraphs-");
+            std::string nodes = subgraphs(chain, NODES, true);
+            std::string edges = subgraphs(chain, EDGES, false);
+            chain.extract_subgraphs();
+            chain.clear();
+            if (nodes == edges) {
+              common::filesystem::copy(nodes, nodes_name);
+            } else {
+              common::filesystem::move(nodes, nodes_name);
+            }
+            common::filesystem::move(edges, edges_name);
+          }
+          std::stringstream queries;
+          {
+            FingerprintWriter fingerprints(index_name, nodes_name);
+            fingerprints.add_features(features_name);
+            fingerprints.process(KNOWLEDGE_BASE + "settings.json", edges_name, queries);
+          }
+          std::stringstream mined;
+          MINE->select(queries, mined, query_name);
+          std::stringstream statistics;
+          CLASSIFIER->classify(mined, statistics);
+          std::stringstream prediction;
+          PREDICTOR->predict(statistics, prediction, statistics_name);
+
+          std::stringstream output;
+          switch (format) {
+            case 'x':
+              Assignator::Xml(index_name, prediction, output);
+              break;
+            case 'l':
+              Assignator::List(index_name, prediction, output);
+              break;
+            default:
+              Assignator::Csv(delimiter, index_name, prediction, output);
+              break;
+          }
+          common::filesystem::remove_recursively(temp_dir);
+          return output.str();
+        } catch (...) {
+          common::filesystem::remove_recursively(temp_dir);
+          throw;
+        }
+      }
+    };
+  }
+}
@@ -7,7 +7,31 @@ namespace inspire {
   namespace backend {
     class Predictor {
       public:
-      virtual void predict(std::string input, std::string output) = 0;
+      // Predict classes of residues from counts of classes read from <reader>, e.g. kept in memory, into <writer>
+      // <input> Name of the input in error messages
+      virtual void predict(std::istream &reader, std::ostream &writer, const std::string &input) const = 0;
+
+      void predict(std::string input, std::string output) const {
+        if (output.empty() || output.back() == common::filesystem::directory_separator) {
+          size_t i = input.rfind(common::filesystem::directory_separator);
+          std::string tmp = (i == input.npos ? input : input.substr(i+1));
+          if (common::string::ends_with(tmp, ".sas")) {
+            output += tmp.substr(0, tmp.size()-4);
+          } else {
+            output += tmp;
+          }
+          output += ".pec";
+        } else if (!common::string::ends_with(output, ".pec")) {
+          output += ".pec";
+        }
+
+        std::ifstream reader(input);
+        std::ofstream writer(output);
+        predict(reader, writer, input);
+        reader.close();
+        writer.flush();
+        writer.close();
+      }
     };
 
     class WeightedPredictor : public Predictor {
@@ -30,22 +54,9 @@ namespace inspire {
         WEIGHTS.push_back(rest);
       }
 
-      void predict(std::string input, std::string output) override {
-        if (output.empty() || output.back() == common::filesystem::directory_separator) {
-          size_t i = input.rfind(common::filesystem::directory_separator);
-          std::string tmp = (i == input.npos ? input : input.substr(i+1));
-          if (common::string::ends_with(tmp, ".sas")) {
-            output += tmp.substr(0, tmp.size()-4);
-          } else {
-            output += tmp;
-          }
-          output += ".pec";
-        } else if (!common::string::ends_with(output, ".pec")) {
-          output += ".pec";
-        }
+      using Predictor::predict;
 
-        std::ifstream reader(input);
-        std::ofstream writer(output);
+      void predict(std::istream &reader, std::ostream &writer, const std::string &input) const override {
         std::string line;
         if (!std::getline(reader, line)) {
           throw common::exception::TitledException("Input file '" + input + "' is empty.");
@@ -93,9 +104,6 @@ namespace inspire {
           }
           writer << id << '\t' << (best_value == 0 ? "" : headers[best_index]) << '\n';
         }
-        reader.close();
-        writer.flush();
-        writer.close();
       }
 
     };
@@ -132,22 +140,9 @@ namespace inspire {
         }
       }
 
-      void predict(std::string input, std::string output) override {
-        if (output.empty() || output.back() == common::filesystem::directory_separator) {
-          size_t i = input.rfind(common::filesystem::directory_separator);
-          std::string tmp = (i == input.npos ? input : input.substr(i+1));
-          if (common::string::ends_with(tmp, ".sas")) {
-            output += tmp.substr(0, tmp.size()-4);
-          } else {
-            output += tmp;
-          }
-          output += ".pec";
-        } else if (!common::string::ends_with(output, ".pec")) {
-          output += ".pec";
-        }
+      using Predictor::predict;
 
-        std::ifstream reader(input);
-        std::ofstream writer(output);
+      void predict(std::istream &reader, std::ostream &writer, const std::string &input) const override {
         std::string line;
         if (!std::getline(reader, line)) {
           throw common::exception::TitledException("Input file '" + input + "' is empty.");
@@ -192,9 +187,6 @@ namespace inspire {
           }
           writer << id << '\t' << (counts[best] == 0 ? "" : headers[best]) << '\n';
         }
-        reader.close();
-        writer.flush();
-        writer.close();
       }
 
     };
@@ -0,0 +1,255 @@
+#pragma once
+
+#include "../common/bitset.h"
+#include "../common/exception.h"
+#include "../common/string.h"
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace inspire {
+  namespace backend {
+    // Query fingerprints are stored either as text ('.fit'), i.e. a line per query with the identifier, features of the central residue
+    // and the fingerprint as a string of '0' and '1', or packed ('.fiq') with the fingerprints stored in the same way as in a knowledge-base.
+    // Layout of a packed file (native byte order):
+    //   header:   QUERY_MAGIC, uint32 length of fingerprints in bytes, uint32 number of features, (uint32 length, name of the feature)*
+    //   records:  (int32 identifier, (uint32 length, value of the feature)*, fingerprint)*
+    inline const char *QUERY_MAGIC() {
+      return "INSPiREq";
+    }
+    static const size_t QUERY_MAGIC_LENGTH = 8;
+
+    // A query fingerprint; the fingerprint is packed with the bit i in the bit (i % 8) of the byte (i / 8)
+    struct Query {
+      int ID;
+      // Key of the group of a knowledge-base created from features of the central residue
+      std::string KEY;
+      std::string FINGERPRINT;
+    };
+
+    // Create unique key from features to ensure its consistency between knowledge-base loading and prediction
+    inline std::string create_key(const std::map<std::string, std::string> &features) {
+      //? Will be some 'stringbuilder' e.g. std::stringstream significantly more effective?
+      std::string ret;
+      for (auto features_it = features.begin(); features_it != features.end(); ++features_it) {
+        if (!ret.empty()) {
+          ret += ".";
+        }
+        ret += features_it->second;
+      }
+      return ret;
+    }
+
+    // Reads query fingerprints one by one from a text or a packed file (recognized by its header)
+    class QueryReader {
+      private:
+      // The query file if it was opened by its path
+      std::ifstream FILE_STREAM;
+      std::istream &STREAM;
+      // Features of central residues that form keys of groups
+      const std::set<std::string> FILTERS;
+      bool PACKED;
+      // Length of fingerprints in bytes in a packed file
+      uint32_t LENGTH;
+      // Names of features in a packed file
+      std::vector<std::string> HEADERS;
+      // Buffers reused for every query
+      std::string LINE;
+      std::map<std::string, std::string> FEATURES;
+
+      template<typename T>
+      bool read(T &value) {
+        return (bool)STREAM.read(reinterpret_cast<char *>(&value), sizeof(value));
+      }
+
+      bool read(std::string &value) {
+        uint32_t length;
+        if (!read(length)) {
+          return false;
+        }
+        value.resize(length);
+        return length == 0 || STREAM.read(&value[0], length);
+      }
+
+      // Parse a line of a text file, returns false for an invalid line
+      bool parse(const std::string &line, Query &query) {
+        std::string key;
+        query.FINGERPRINT.clear();
+        std::stringstream stream(line);
+
+        // Load id of task
+        if (!std::getline(stream, key, '\t')) { return false; }
+        query.ID = std::stoi(key);
+
+        // Load features of central residue
+        FEATURES.clear();
+        //? Will be "value" as constant for whole program or it will be created every iteration?
+        while (std::getline(stream, key, ':') && !stream.eof()) {
+          std::string value;
+          std::getline(stream, value, '\t');
+          std::set<std::string>::iterator it = FILTERS.find(key);
+          if (it != FILTERS.end()) {
+            // TODO: Binning of the feature. Maybe JSON file for creation of fingerprints can be reused. Just optional.
+            FEATURES.insert({key, value});
+          }
+        }
+
+        // Load fingerprint
+        char current = 0;
+        for (size_t i = 0; i < key.size(); i++) {
+          if (key[i] == '1') {
+            current += 1 << (i % 8);
+          }
+          if ((i & 7) == 7) {
+            query.FINGERPRINT += current;
+            current = 0;
+          }
+        }
+        size_t tail = key.size() % 8;
+        if (tail > 0) {
+          // Just aesthetic reasons to have fingerprint consistently compact form left to right
+          //current <<= (8-tail);
+          query.FINGERPRINT += current;
+        }
+
+        // Create a key from features
+        query.KEY = create_key(FEATURES);
+        return true;
+      }
+
+      // <name> Name of the query file in error messages
+      void read_header(const std::string &name) {
+        std::streampos start = STREAM.tellg();
+        char magic[QUERY_MAGIC_LENGTH];
+        if (STREAM.read(magic, QUERY_MAGIC_LENGTH) && std::memcmp(magic, QUERY_MAGIC(), QUERY_MAGIC_LENGTH) == 0) {
+          PACKED = true;
+          uint32_t count;
+          if (!read(LENGTH) || !read(count)) {
+            throw common::exception::TitledException("The header of the query file '" + name + "' is truncated");
+          }
+          HEADERS.resize(count);
+          for (auto headers_it = HEADERS.begin(); headers_it != HEADERS.end(); ++headers_it) {
+            if (!read(*headers_it)) {
+              throw common::exception::TitledException("The header of the query file '" + name + "' is truncated");
+            }
+          }
+        } else {
+          STREAM.clear();
+          STREAM.seekg(start);
+        }
+      }
+
+      public:
+      // <filters> Features of central residues that form keys of groups
+      QueryReader(const std::string &path, const std::set<std::string> &filters)
+          : FILE_STREAM(path, std::ios::in | std::ios::binary), STREAM(FILE_STREAM), FILTERS(filters), PACKED(false), LENGTH(0) {
+        read_header(path);
+      }
+
+      // Read queries from <stream>, e.g. from fingerprints kept in memory
+      // <name> Name of the queries in error messages
+      QueryReader(std::istream &stream, const std::set<std::string> &filters, const std::string &name)
+          : STREAM(stream), FILTERS(filters), PACKED(false), LENGTH(0) {
+        read_header(name);
+      }
+
+      // Read the next query, returns false at the end of the file; invalid lines of a text file are skipped
+      bool next(Query &query) {
+        if (PACKED) {
+          int32_t id;
+          if (!read(id)) {
+            return false;
+          }
+          query.ID = id;
+          FEATURES.clear();
+          for (auto headers_it = HEADERS.begin(); headers_it != HEADERS.end(); ++headers_it) {
+            if (!read(LINE)) {
+              throw common::exception::TitledException("The query no. " + std::to_string(id) + " is truncated");
+            }
+            if (FILTERS.find(*headers_it) != FILTERS.end()) {
+              FEATURES.insert({*headers_it, LINE});
+            }
+          }
+          query.KEY = create_key(FEATURES);
+          query.FINGERPRINT.resize(LENGTH);
+          if (LENGTH > 0 && !STREAM.read(&query.FINGERPRINT[0], LENGTH)) {
+            throw common::exception::TitledException("The query no. " + std::to_string(id) + " is truncated");
+          }
+          return true;
+        }
+        while (std::getline(STREAM, LINE)) {
+          if (parse(LINE, query)) {
+            return true;
+          }
+        }
+        return false;
+      }
+    };
+
+    // Write query fingerprints in the packed format
+    class QueryWriter {
+      private:
+      // The query file if it was created by its path
+      std::ofstream FILE_STREAM;
+      std::ostream &STREAM;
+      // Length of fingerprints in bytes
+      uint32_t LENGTH;
+      // Packed bytes of the written fingerprint
+      std::string BUFFER;
+
+      void write(const std::string &value) {
+        uint32_t length = value.size();
+        STREAM.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        STREAM.write(value.data(), length);
+      }
+
+      void write_header(const std::vector<std::string> &headers) {
+        STREAM.write(QUERY_MAGIC(), QUERY_MAGIC_LENGTH);
+        uint32_t count = headers.size();
+        STREAM.write(reinterpret_cast<const char*>(&LENGTH), sizeof(LENGTH));
+        STREAM.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (auto headers_it = headers.begin(); headers_it != headers.end(); ++headers_it) {
+          write(*headers_it);
+        }
+      }
+
+      public:
+      // <bits> Length of fingerprints in bits
+      QueryWriter(const std::string &path, const std::vector<std::string> &headers, size_t bits)
+          : FILE_STREAM(path, std::ios::out | std::ios::binary), STREAM(FILE_STREAM), LENGTH(bits == 0 ? 0 : ((bits-1)/CHAR_BIT+1)), BUFFER(LENGTH, '\0') {
+        if (!FILE_STREAM.is_open()) {
+          throw common::exception::TitledException("It is not possible to create the query file '" + path + "'");
+        }
+        write_header(headers);
+      }
+
+      // Write queries into <stream>, e.g. to keep them in memory
+      QueryWriter(std::ostream &stream, const std::vector<std::string> &headers, size_t bits)
+          : STREAM(stream), LENGTH(bits == 0 ? 0 : ((bits-1)/CHAR_BIT+1)), BUFFER(LENGTH, '\0') {
+        write_header(headers);
+      }
+
+      void write(int32_t id, const std::vector<std::string> &residue, const common::bitset::Bitset &fingerprint) {
+        STREAM.write(reinterpret_cast<const char*>(&id), sizeof(id));
+        for (auto residue_it = residue.begin(); residue_it != residue.end(); ++residue_it) {
+          write(*residue_it);
+        }
+        fingerprint.bytes(&BUFFER[0], LENGTH);
+        STREAM.write(BUFFER.data(), LENGTH);
+      }
+
+      void close() {
+        STREAM.flush();
+        if (FILE_STREAM.is_open()) {
+          FILE_STREAM.close();
+        }
+      }
+    };
+  }
+}
@@ -0,0 +1,674 @@
+#pragma once
+
+#include "knowledgebase.h"
+#include "../common/exception.h"
+#include "../common/hamming.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace inspire {
+  namespace backend {
+    // A fingerprint of a group (its index) and its distance from a query; ordering by distance, then by index
+    typedef std::pair<int, uint32_t> Neighbour;
+
+    // Sorted disjoint closed intervals [first; second] of identifiers of structural elements.
+    // Structural elements of a protein have consecutive identifiers, so a protein is usually a single interval.
+    typedef std::vector<std::pair<uint32_t, uint32_t> > IdRanges;
+
+    // Compress a list of identifiers (in any order, possibly with duplicates) into intervals
+    inline IdRanges make_ranges(std::vector<uint32_t> ids) {
+      std::sort(ids.begin(), ids.end());
+      IdRanges ranges;
+      for (auto ids_it = ids.begin(); ids_it != ids.end(); ++ids_it) {
+        if (!ranges.empty() && *ids_it <= ranges.back().second + (uint64_t)1) {
+          ranges.back().second = std::max(ranges.back().second, *ids_it);
+        } else {
+          ranges.push_back({*ids_it, *ids_it});
+        }
+      }
+      return ranges;
+    }
+
+    // Structural elements that cannot be used as templates for the current query (e.g. they are from the same protein)
+    class Siblings {
+      private:
+      const IdRanges *EXCLUDED;
+
+      public:
+      // <excluded> Excluded structural elements or nullptr if nothing is excluded
+      Siblings(const IdRanges *excluded) : EXCLUDED(excluded) { }
+
+      bool empty() const {
+        return EXCLUDED == nullptr || EXCLUDED->empty();
+      }
+
+      bool contains(uint32_t id) const {
+        if (EXCLUDED == nullptr) {
+          return false;
+        }
+        // The last interval that starts at most at id
+        auto range_it = std::upper_bound(EXCLUDED->begin(), EXCLUDED->end(), id, [](uint32_t value, const std::pair<uint32_t, uint32_t> &range) {
+          return value < range.first;
+        });
+        return range_it != EXCLUDED->begin() && id <= (--range_it)->second;
+      }
+
+      // Number of structural elements with the given fingerprint that can be used as templates
+      size_t count(const FingerprintGroup &group, size_t index) const {
+        if (empty()) {
+          return group.count(index);
+        }
+        size_t count = 0;
+        uint32_t id;
+        for (Postings ids = group.ids(index); ids.next(id); ) {
+          if (!contains(id)) {
+            ++count;
+          }
+        }
+        return count;
+      }
+    };
+
+    // Bounded selection of the nearest fingerprints: fingerprints are kept up to the distance of the <limit>-th nearest usable template,
+    // all fingerprints with the same distance are kept too, so the result does not depend on the order in which fingerprints are added
+    class Nearest {
+      private:
+      struct Entry {
+        int DISTANCE;
+        uint32_t INDEX;
+        // Number of usable templates with the fingerprint
+        size_t TEMPLATES;
+
+        bool operator<(const Entry &other) const {
+          return DISTANCE < other.DISTANCE || (DISTANCE == other.DISTANCE && INDEX < other.INDEX);
+        }
+      };
+
+      size_t LIMIT;
+      // Max-heap of kept fingerprints
+      std::vector<Entry> HEAP;
+      // Fingerprints with the largest distance when it is tested whether they are still necessary
+      std::vector<Entry> FARTHEST;
+      // Number of usable templates in HEAP
+      size_t TEMPLATES;
+
+      public:
+      Nearest(size_t limit) : LIMIT(limit), TEMPLATES(0) { }
+
+      // Remove all fingerprints
+      void clear() {
+        HEAP.clear();
+        TEMPLATES = 0;
+      }
+
+      void limit(size_t limit) {
+        LIMIT = limit;
+        clear();
+      }
+
+      // Fingerprints with a larger distance cannot be added
+      int bound() const {
+        if (TEMPLATES < LIMIT) {
+          return std::numeric_limits<int>::max();
+        }
+        return HEAP.empty() ? -1 : HEAP.front().DISTANCE;
+      }
+
+      // <templates> Number of usable templates with the fingerprint
+      void add(int distance, uint32_t index, size_t templates) {
+        if (templates == 0 || distance > bound()) {
+          return;
+        }
+        bool farthest = HEAP.empty() || distance >= HEAP.front().DISTANCE;
+        HEAP.push_back(Entry{distance, index, templates});
+        std::push_heap(HEAP.begin(), HEAP.end());
+        TEMPLATES += templates;
+        // Fingerprints with the largest distance are dropped when there are enough templates without them
+        while (!farthest) {
+          FARTHEST.clear();
+          size_t dropped = 0;
+          int largest = HEAP.front().DISTANCE;
+          while (!HEAP.empty() && HEAP.front().DISTANCE == largest) {
+            dropped += HEAP.front().TEMPLATES;
+            FARTHEST.push_back(HEAP.front());
+            std::pop_heap(HEAP.begin(), HEAP.end());
+            HEAP.pop_back();
+          }
+          if (TEMPLATES - dropped >= LIMIT) {
+            TEMPLATES -= dropped;
+          } else {
+            for (auto farthest_it = FARTHEST.begin(); farthest_it != FARTHEST.end(); ++farthest_it) {
+              HEAP.push_back(*farthest_it);
+              std::push_heap(HEAP.begin(), HEAP.end());
+            }
+            farthest = true;
+          }
+        }
+      }
+
+      // Kept fingerprints sorted by distance
+      void result(std::vector<Neighbour> &neighbours) const {
+        neighbours.clear();
+        for (auto heap_it = HEAP.begin(); heap_it != HEAP.end(); ++heap_it) {
+          neighbours.push_back(Neighbour(heap_it->DISTANCE, heap_it->INDEX));
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+      }
+    };
+
+    // Search for the most similar fingerprints within a single group of a knowledge-base
+    class SearchEngine {
+      protected:
+      // Number of fingerprints whose distance from a query was computed, summed over all searches
+      mutable std::atomic<uint64_t> COMPARED;
+
+      public:
+      SearchEngine() : COMPARED(0) { }
+      virtual ~SearchEngine() { }
+
+      // How many fingerprints were compared with queries, i.e. were not skipped by the engine
+      virtual uint64_t compared() const {
+        return COMPARED;
+      }
+
+      // Add fingerprints nearest to the <query> (padded to the group's stride) into <nearest>
+      virtual void search(const char *query, const Siblings &siblings, Nearest &nearest) const = 0;
+
+      // Search for <count> queries at once, so engines can share work among the queries
+      virtual void search(size_t count, const char *const *queries, const Siblings *siblings, Nearest *nearest) const {
+        for (size_t i = 0; i < count; ++i) {
+          search(queries[i], siblings[i], nearest[i]);
+        }
+      }
+    };
+
+    // Compares the query with fingerprints of the group, the difference of popcounts is a lower bound of the distance, thus fingerprints can be skipped
+    // when the difference exceeds the distance of the farthest kept fingerprint. Fingerprints with popcounts near the query's popcount are compared first
+    // to get a tight bound early, the rest of fingerprints is compared in the order of the arena.
+    // Multiple queries are compared with blocks of fingerprints small enough to stay in the cache, so the arena is read once for all of them.
+    class ScanEngine : public SearchEngine {
+      public:
+      // Size of a block of fingerprints in bytes (fits into L1 cache)
+      static const size_t BLOCK = 16384;
+
+      private:
+      const FingerprintGroup &GROUP;
+      // Popcount of each fingerprint
+      std::vector<uint16_t> POPCOUNTS;
+      // Indices of fingerprints sorted by popcount and the first index for each popcount (and the end)
+      std::vector<uint32_t> ORDER;
+      std::vector<uint32_t> FIRST;
+
+      int largest() const {
+        return (int)FIRST.size() - 2;
+      }
+
+      // Compare the query with fingerprints with the nearest popcounts until the first bound is known,
+      // returns the smallest popcount difference of fingerprints that were not compared
+      int seed(const char *query, int popcount, const Siblings &siblings, Nearest &nearest, size_t &compared) const {
+        int difference = 0;
+        for (; difference <= largest() && nearest.bound() == std::numeric_limits<int>::max(); ++difference) {
+          for (int sign = -1; sign <= 1; sign += 2) {
+            int current = popcount + sign * difference;
+            if ((difference == 0 && sign > 0) || current < 0 || current > largest()) {
+              continue;
+            }
+            compared += FIRST[current + 1] - FIRST[current];
+            for (uint32_t j = FIRST[current]; j < FIRST[current + 1]; ++j) {
+              uint32_t i = ORDER[j];
+              int distance = common::hamming::distance(query, GROUP.fingerprint(i), GROUP.stride());
+              if (distance <= nearest.bound()) {
+                nearest.add(distance, i, siblings.count(GROUP, i));
+              }
+            }
+          }
+        }
+        return difference;
+      }
+
+      // The popcount check is a branch that is hard to predict, thus it pays off only when most of fingerprints are skipped
+      bool selective(int popcount, int bound) const {
+        size_t passed = FIRST[std::min(popcount + bound, largest()) + 1] - FIRST[std::max(popcount - bound, 0)];
+        return passed * 8 < GROUP.size();
+      }
+
+      // Compare the query with the rest of fingerprints with a popcount check
+      void filtered(const char *query, int popcount, int difference, const Siblings &siblings, Nearest &nearest, size_t &compared) const {
+        for (size_t i = 0; i < GROUP.size(); ++i) {
+          int current = std::abs((int)POPCOUNTS[i] - popcount);
+          if (current >= difference && current <= nearest.bound()) {
+            ++compared;
+            int distance = common::hamming::distance(query, GROUP.fingerprint(i), GROUP.stride());
+            if (distance <= nearest.bound()) {
+              nearest.add(distance, i, siblings.count(GROUP, i));
+            }
+          }
+        }
+      }
+
+      public:
+      ScanEngine(const FingerprintGroup &group) : GROUP(group), POPCOUNTS(group.size()), ORDER(group.size()), FIRST(8 * group.stride() + 2, 0) {
+        for (size_t i = 0; i < GROUP.size(); ++i) {
+          POPCOUNTS[i] = common::hamming::popcount(GROUP.fingerprint(i), GROUP.stride());
+          ++FIRST[POPCOUNTS[i] + 1];
+        }
+        for (size_t i = 1; i < FIRST.size(); ++i) {
+          FIRST[i] += FIRST[i-1];
+        }
+        std::vector<uint32_t> next(FIRST.begin(), FIRST.end() - 1);
+        for (size_t i = 0; i < GROUP.size(); ++i) {
+          ORDER[next[POPCOUNTS[i]]++] = i;
+        }
+      }
+
+      void search(const char *query, const Siblings &siblings, Nearest &nearest) const {
+        search(1, &query, &siblings, &nearest);
+      }
+
+      void search(size_t count, const char *const *queries, const Siblings *siblings, Nearest *nearest) const {
+        size_t stride = GROUP.stride();
+        // Queries compared with all fingerprints, their popcounts and popcount differences of fingerprints that were not compared yet
+        std::vector<size_t> blocked;
+        std::vector<int> popcounts(count);
+        std::vector<int> differences(count);
+        size_t compared = 0;
+        for (size_t q = 0; q < count; ++q) {
+          popcounts[q] = common::hamming::popcount(queries[q], stride);
+          differences[q] = seed(queries[q], popcounts[q], siblings[q], nearest[q], compared);
+          if (differences[q] > largest() || differences[q] > nearest[q].bound()) {
+            continue;
+          }
+          if (selective(popcounts[q], nearest[q].bound())) {
+            filtered(queries[q], popcounts[q], differences[q], siblings[q], nearest[q], compared);
+          } else {
+            blocked.push_back(q);
+            // Blocks are compared as a whole, except for fingerprints compared when seeding
+            compared += GROUP.size() - (FIRST[std::min(popcounts[q] + differences[q], largest() + 1)] - FIRST[std::max(popcounts[q] - differences[q] + 1, 0)]);
+          }
+        }
+        COMPARED.fetch_add(compared, std::memory_order_relaxed);
+        if (blocked.empty()) {
+          return;
+        }
+
+        // A single query is compared directly, otherwise each block is packed once and reused by all queries
+        size_t words = stride / sizeof(uint64_t);
+        size_t block = std::max(BLOCK / stride / common::hamming::LANES, (size_t)1) * common::hamming::LANES;
+        bool pack = blocked.size() > 1;
+        std::vector<int> distances(block);
+        std::vector<uint64_t> packed(pack ? block * words : 0);
+        std::vector<uint64_t> words_queries(pack ? blocked.size() * words : 0);
+        for (size_t b = 0; pack && b < blocked.size(); ++b) {
+          for (size_t w = 0; w < words; ++w) {
+            words_queries[b * words + w] = common::hamming::load_word(queries[blocked[b]] + w * sizeof(uint64_t));
+          }
+        }
+        for (size_t first = 0; first < GROUP.size(); first += block) {
+          size_t size = std::min(block, GROUP.size() - first);
+          size_t groups = (size + common::hamming::LANES - 1) / common::hamming::LANES;
+          if (pack) {
+            common::hamming::pack(GROUP.fingerprint(first), stride, size, packed.data());
+          }
+          for (size_t b = 0; b < blocked.size(); ++b) {
+            size_t q = blocked[b];
+            if (pack) {
+              common::hamming::packed(packed.data(), words, groups, words_queries.data() + b * words, distances.data());
+            } else {
+              common::hamming::block(queries[q], GROUP.fingerprint(first), stride, size, distances.data());
+            }
+            int bound = nearest[q].bound();
+            for (size_t j = 0; j < size; ++j) {
+              // Fingerprints with popcount difference below 'differences' were already compared when seeding
+              if (distances[j] <= bound && std::abs((int)POPCOUNTS[first + j] - popcounts[q]) >= differences[q]) {
+                nearest[q].add(distances[j], first + j, siblings[q].count(GROUP, first + j));
+                bound = nearest[q].bound();
+              }
+            }
+          }
+        }
+      }
+    };
+
+    // Exact multi-index hashing (Norouzi et al.): fingerprints are split into 16-bit substrings and each substring position is indexed separately.
+    // If a fingerprint has distance at most r from the query, at least one of its M substrings has distance at most r/M from the corresponding substring of the query,
+    // thus substrings of the query are probed with increasing radius until the nearest fingerprints are guaranteed to be found.
+    // When probing would be more expensive than comparing all fingerprints, the whole group is scanned.
+    class MultiIndexEngine : public SearchEngine {
+      public:
+      // Bits in a substring
+      static const int WIDTH = 16;
+
+      private:
+      const FingerprintGroup &GROUP;
+      // Number of substrings
+      size_t CHUNKS;
+      // For each substring position sorted values of the substring (VALUES) and indices of fingerprints with the value (INDICES), i.e. [chunk * size + i]
+      std::vector<uint16_t> VALUES;
+      std::vector<uint32_t> INDICES;
+      // Cost of a single probe (binary search) in comparison with a comparison of two fingerprints
+      size_t PROBE;
+      ScanEngine SCAN;
+
+      static uint16_t chunk(const char *fingerprint, size_t index) {
+        return (uint16_t)((unsigned char)fingerprint[2*index] | ((unsigned char)fingerprint[2*index+1] << 8));
+      }
+
+      public:
+      using SearchEngine::search;
+
+      // Fingerprints compared by the fallback scan are included
+      uint64_t compared() const {
+        return COMPARED + SCAN.compared();
+      }
+
+      MultiIndexEngine(const FingerprintGroup &group) : GROUP(group), CHUNKS((group.length() + 1) / 2), PROBE(1), SCAN(group) {
+        size_t size = GROUP.size();
+        while ((size_t)1 << PROBE < size) {
+          ++PROBE;
+        }
+        VALUES.resize(CHUNKS * size);
+        INDICES.resize(CHUNKS * size);
+        std::vector<std::pair<uint16_t, uint32_t> > pairs(size);
+        for (size_t c = 0; c < CHUNKS; ++c) {
+          for (size_t i = 0; i < size; ++i) {
+            pairs[i] = std::make_pair(chunk(GROUP.fingerprint(i), c), (uint32_t)i);
+          }
+          std::sort(pairs.begin(), pairs.end());
+          for (size_t i = 0; i < size; ++i) {
+            VALUES[c * size + i] = pairs[i].first;
+            INDICES[c * size + i] = pairs[i].second;
+          }
+        }
+      }
+
+      void search(const char *query, const Siblings &siblings, Nearest &nearest) const {
+        size_t size = GROUP.size();
+        // Probing is stopped (and the group is scanned) when the work exceeds the work of the scan,
+        // a found fingerprint is compared twice (when it is checked whether it was already found and when the distance is computed)
+        size_t budget = size;
+        size_t work = 0;
+        size_t compared = 0;
+        for (int radius = 0; radius <= WIDTH; ++radius) {
+          for (size_t c = 0; c < CHUNKS; ++c) {
+            uint16_t value = chunk(query, c);
+            const uint16_t *values = VALUES.data() + c * size;
+            const uint32_t *indices = INDICES.data() + c * size;
+            // All masks with 'radius' bits set (Gosper's hack)
+            uint32_t mask = (1u << radius) - 1;
+            while (mask < (1u << WIDTH)) {
+              const uint16_t probe = value ^ (uint16_t)mask;
+              const uint16_t *low = std::lower_bound(values, values + size, probe);
+              for (; low != values + size && *low == probe; ++low) {
+                uint32_t index = indices[low - values];
+                // The fingerprint was already found if any substring is nearer, or equally near in a previously probed substring
+                const char *fingerprint = GROUP.fingerprint(index);
+                bool found = false;
+                for (size_t k = 0; k < CHUNKS && !found; ++k) {
+                  int distance = common::hamming::popcount_portable((uint16_t)(chunk(query, k) ^ chunk(fingerprint, k)));
+                  found = distance < radius || (distance == radius && k < c);
+                }
+                if (!found) {
+                  ++compared;
+                  int distance = common::hamming::distance(query, fingerprint, GROUP.stride());
+                  if (distance <= nearest.bound()) {
+                    nearest.add(distance, index, siblings.count(GROUP, index));
+                  }
+                }
+                work += 2;
+              }
+              if ((work += PROBE) > budget) {
+                COMPARED.fetch_add(compared, std::memory_order_relaxed);
+                nearest.clear();
+                SCAN.search(query, siblings, nearest);
+                return;
+              }
+              if (mask == 0) {
+                break;
+              }
+              uint32_t lowest = mask & -mask;
+              uint32_t ripple = mask + lowest;
+              mask = (((ripple ^ mask) >> 2) / lowest) | ripple;
+            }
+          }
+
+          // Fingerprints that were not found yet have distance at least CHUNKS * (radius + 1)
+          if (nearest.bound() < (int)CHUNKS * (radius + 1)) {
+            break;
+          }
+        }
+        COMPARED.fetch_add(compared, std::memory_order_relaxed);
+      }
+    };
+
+    // Approximate search by bit-sampling locality-sensitive hashing: each table hashes fingerprints by a few randomly sampled bits,
+    // so fingerprints near the query share a bucket with the query in at least one table with a high probability.
+    // Only fingerprints from buckets of the query are compared, thus some of the nearest fingerprints can be missed;
+    // more tables mean a higher recall and a slower search. If fewer templates than required are found, the group is scanned.
+    class LshEngine : public SearchEngine {
+      private:
+      const FingerprintGroup &GROUP;
+      size_t TABLES;
+      // Sampled bits of each table, i.e. [table * WIDTH + j]
+      size_t WIDTH;
+      std::vector<uint32_t> BITS;
+      // For each table sorted keys (KEYS) and indices of fingerprints with the key (INDICES), i.e. [table * size + i]
+      std::vector<uint32_t> KEYS;
+      std::vector<uint32_t> INDICES;
+      ScanEngine SCAN;
+
+      uint32_t key(const char *fingerprint, size_t table) const {
+        uint32_t key = 0;
+        const uint32_t *bits = BITS.data() + table * WIDTH;
+        for (size_t j = 0; j < WIDTH; ++j) {
+          key = (key << 1) | ((fingerprint[bits[j] / 8] >> (bits[j] % 8)) & 1);
+        }
+        return key;
+      }
+
+      public:
+      using SearchEngine::search;
+
+      // Fingerprints compared by the fallback scan are included
+      uint64_t compared() const {
+        return COMPARED + SCAN.compared();
+      }
+
+      // <tables> Number of hash tables
+      LshEngine(const FingerprintGroup &group, size_t tables) : GROUP(group), TABLES(std::max(tables, (size_t)1)), WIDTH(1), SCAN(group) {
+        size_t size = GROUP.size();
+        size_t bits = 8 * GROUP.length();
+        // Buckets have 8 fingerprints on average
+        while (WIDTH < 24 && ((size_t)8 << WIDTH) < size) {
+          ++WIDTH;
+        }
+        WIDTH = std::min(WIDTH, bits);
+        // Fixed seed, so results do not differ between runs
+        std::mt19937 random(5489u);
+        std::vector<uint32_t> positions(bits);
+        for (size_t i = 0; i < bits; ++i) {
+          positions[i] = i;
+        }
+        BITS.resize(TABLES * WIDTH);
+        for (size_t t = 0; t < TABLES; ++t) {
+          for (size_t j = 0; j < WIDTH; ++j) {
+            std::swap(positions[j], positions[j + random() % (bits - j)]);
+            BITS[t * WIDTH + j] = positions[j];
+          }
+        }
+        KEYS.resize(TABLES * size);
+        INDICES.resize(TABLES * size);
+        std::vector<std::pair<uint32_t, uint32_t> > pairs(size);
+        for (size_t t = 0; t < TABLES; ++t) {
+          for (size_t i = 0; i < size; ++i) {
+            pairs[i] = std::make_pair(key(GROUP.fingerprint(i), t), (uint32_t)i);
+          }
+          std::sort(pairs.begin(), pairs.end());
+          for (size_t i = 0; i < size; ++i) {
+            KEYS[t * size + i] = pairs[i].first;
+            INDICES[t * size + i] = pairs[i].second;
+          }
+        }
+      }
+
+      void search(const char *query, const Siblings &siblings, Nearest &nearest) const {
+        size_t size = GROUP.size();
+        std::vector<uint32_t> candidates;
+        for (size_t t = 0; t < TABLES; ++t) {
+          const uint32_t *keys = KEYS.data() + t * size;
+          auto range = std::equal_range(keys, keys + size, key(query, t));
+          candidates.insert(candidates.end(), INDICES.data() + t * size + (range.first - keys), INDICES.data() + t * size + (range.second - keys));
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        COMPARED.fetch_add(candidates.size(), std::memory_order_relaxed);
+        for (auto candidates_it = candidates.begin(); candidates_it != candidates.end(); ++candidates_it) {
+          int distance = common::hamming::distance(query, GROUP.fingerprint(*candidates_it), GROUP.stride());
+          if (distance <= nearest.bound()) {
+            nearest.add(distance, *candidates_it, siblings.count(GROUP, *candidates_it));
+          }
+        }
+        if (nearest.bound() == std::numeric_limits<int>::max()) {
+          nearest.clear();
+          SCAN.search(query, siblings, nearest);
+        }
+      }
+    };
+
+    // Exact search pruned by the triangle inequality: distances of all fingerprints from a few pivots are precomputed,
+    // thus |d(q, p) - d(f, p)| is a lower bound of d(q, f) for every pivot p. Fingerprints are compared in the order of their largest bound
+    // and the search stops when the bound exceeds the distance of the farthest kept fingerprint.
+    // The first pivot is the empty fingerprint (i.e. the bound of the popcount used by the scan), the others are chosen by farthest-first traversal,
+    // so they are spread over the group.
+    class PivotEngine : public SearchEngine {
+      public:
+      // Number of pivots
+      static const size_t PIVOTS = 16;
+      // Number of fingerprints with the smallest bounds that are compared first to get the first bound of the distance
+      static const size_t SEED = 64;
+
+      private:
+      const FingerprintGroup &GROUP;
+      // Pivots padded to the group's stride, i.e. [pivot * stride]
+      std::string PIVOT;
+      // Distances of fingerprints from pivots, i.e. [pivot * size + i], so bounds are computed by sequential passes
+      std::vector<uint16_t> DISTANCES;
+
+      // Compare fingerprints sorted by their bounds (stable counting sort) until the bound exceeds the distance of the farthest kept fingerprint
+      void compare(const char *query, const std::vector<uint16_t> &bounds, std::vector<uint32_t> &candidates, int lowest, int highest,
+          const Siblings &siblings, Nearest &nearest, size_t &compared) const {
+        std::vector<uint32_t> first(highest - lowest + 2, 0);
+        for (auto candidates_it = candidates.begin(); candidates_it != candidates.end(); ++candidates_it) {
+          ++first[bounds[*candidates_it] - lowest + 1];
+        }
+        for (size_t b = 1; b < first.size(); ++b) {
+          first[b] += first[b-1];
+        }
+        std::vector<uint32_t> order(candidates.size());
+        for (auto candidates_it = candidates.begin(); candidates_it != candidates.end(); ++candidates_it) {
+          order[first[bounds[*candidates_it] - lowest]++] = *candidates_it;
+        }
+        for (auto order_it = order.begin(); order_it != order.end() && bounds[*order_it] <= nearest.bound(); ++order_it) {
+          ++compared;
+          int distance = common::hamming::distance(query, GROUP.fingerprint(*order_it), GROUP.stride());
+          if (distance <= nearest.bound()) {
+            nearest.add(distance, *order_it, siblings.count(GROUP, *order_it));
+          }
+        }
+      }
+
+      public:
+      using SearchEngine::search;
+
+      PivotEngine(const FingerprintGroup &group) : GROUP(group), PIVOT(PIVOTS * group.stride(), '\0'), DISTANCES(PIVOTS * group.size()) {
+        size_t size = GROUP.size();
+        size_t stride = GROUP.stride();
+        // Distance of each fingerprint from the nearest pivot chosen so far
+        std::vector<int> nearest(size, std::numeric_limits<int>::max());
+        for (size_t p = 0; p < PIVOTS; ++p) {
+          if (p > 0 && size > 0) {
+            size_t farthest = std::max_element(nearest.begin(), nearest.end()) - nearest.begin();
+            std::copy(GROUP.fingerprint(farthest), GROUP.fingerprint(farthest) + stride, PIVOT.begin() + p * stride);
+          }
+          for (size_t i = 0; i < size; ++i) {
+            int distance = common::hamming::distance(PIVOT.data() + p * stride, GROUP.fingerprint(i), stride);
+            DISTANCES[p * size + i] = distance;
+            nearest[i] = std::min(nearest[i], distance);
+          }
+        }
+      }
+
+      void search(const char *query, const Siblings &siblings, Nearest &nearest) const {
+        size_t size = GROUP.size();
+        size_t stride = GROUP.stride();
+        size_t compared = PIVOTS;
+        // The largest difference of distances from pivots and the number of fingerprints with each bound
+        std::vector<uint16_t> bounds(size, 0);
+        for (size_t p = 0; p < PIVOTS; ++p) {
+          uint16_t pivot = common::hamming::distance(query, PIVOT.data() + p * stride, stride);
+          const uint16_t *distances = DISTANCES.data() + p * size;
+          for (size_t i = 0; i < size; ++i) {
+            uint16_t difference = distances[i] > pivot ? distances[i] - pivot : pivot - distances[i];
+            bounds[i] = std::max(bounds[i], difference);
+          }
+        }
+        std::vector<uint32_t> counts(8 * stride + 1, 0);
+        for (size_t i = 0; i < size; ++i) {
+          ++counts[bounds[i]];
+        }
+        int seed = 0;
+        for (size_t seeded = counts[0]; seeded < SEED && seed + 1 < (int)counts.size(); seeded += counts[++seed]) { }
+
+        // Fingerprints with the smallest bounds give the first bound of the distance, only fingerprints within the bound are compared then
+        std::vector<uint32_t> candidates;
+        for (size_t i = 0; i < size; ++i) {
+          if (bounds[i] <= seed) {
+            candidates.push_back(i);
+          }
+        }
+        compare(query, bounds, candidates, 0, seed, siblings, nearest, compared);
+        int highest = std::min(nearest.bound(), (int)counts.size() - 1);
+        if (highest > seed) {
+          candidates.clear();
+          for (size_t i = 0; i < size; ++i) {
+            if (bounds[i] > seed && bounds[i] <= highest) {
+              candidates.push_back(i);
+            }
+          }
+          compare(query, bounds, candidates, seed + 1, highest, siblings, nearest, compared);
+        }
+        COMPARED.fetch_add(compared, std::memory_order_relaxed);
+      }
+    };
+
+    // Engine with the given name for a group, small groups are always scanned
+    // <tables> Number of hash tables of the approximate engine
+    inline SearchEngine *create_engine(const std::string &name, const FingerprintGroup &group, size_t tables = 8) {
+      if (name == "scan") {
+        return new ScanEngine(group);
+      } else if (name == "mih") {
+        if (group.size() < 1024) {
+          return new ScanEngine(group);
+        }
+        return new MultiIndexEngine(group);
+      } else if (name == "pivot") {
+        if (group.size() < 1024) {
+          return new ScanEngine(group);
+        }
+        return new PivotEngine(group);
+      } else if (name == "lsh") {
+        if (group.size() < 1024) {
+          return new ScanEngine(group);
+        }
+        return new LshEngine(group, tables);
+      }
+      throw common::exception::TitledException("Unknown search engine '" + name + "'");
+    }
+  }
+}
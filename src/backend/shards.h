@@ -0,0 +1,149 @@
+#pragma once
+
+#include "mine.h"
+#include "../common/exception.h"
+#include "../common/filesystem.h"
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace inspire {
+  namespace backend {
+    // Mining with a knowledge-base split into shards, each shard is loaded and searched by its own local process.
+    // The knowledge-base is not loaded by this process at all, every query file is mined by all shards and their partial results are merged,
+    // so the result is the same as if the whole knowledge-base was loaded by a single process.
+    // NOTE: Settings have the same meaning as the settings of Mine, they are passed to the processes of shards.
+    class LocalShards {
+      private:
+      const std::string KNOWLEDGE_BASE;
+      const std::set<std::string> FILTERS;
+      const size_t SHARDS;
+      size_t THREADS;
+      int LIMIT;
+      std::string ENGINE;
+      size_t TABLES;
+      size_t BATCH;
+      bool NUMA;
+      size_t CACHE;
+      // Siblings files in the order they should be loaded
+      std::vector<std::string> EXCLUDES;
+
+      // Mine a query file with a single shard, it is run in a child process
+      void run(size_t shard, const std::string &input, const std::string &output) const {
+        Mine mine(KNOWLEDGE_BASE, FILTERS, THREADS, LIMIT, shard, SHARDS, NUMA);
+        mine.tables(TABLES);
+        mine.engine(ENGINE);
+        mine.batch(BATCH);
+        mine.cache(CACHE);
+        for (auto excludes_it = EXCLUDES.begin(); excludes_it != EXCLUDES.end(); ++excludes_it) {
+          mine.load_excludes(*excludes_it);
+        }
+        mine.select(input, output);
+      }
+
+      public:
+      LocalShards(const std::string &knowledge_base, const std::set<std::string> &filters, size_t shards, size_t threads, int limit)
+        : KNOWLEDGE_BASE(knowledge_base), FILTERS(filters), SHARDS(std::max(shards, (size_t)1)), THREADS(threads), LIMIT(limit), ENGINE("scan"), TABLES(8), BATCH(1), NUMA(false), CACHE(1 << 16) { }
+
+      void threads(size_t threads) {
+        THREADS = threads;
+      }
+
+      void limit(int limit) {
+        LIMIT = limit;
+      }
+
+      void engine(const std::string &engine) {
+        // Check the name in advance, so an unknown engine is not reported by every shard
+        std::unique_ptr<SearchEngine> test(create_engine(engine, FingerprintGroup()));
+        ENGINE = engine;
+      }
+
+      void tables(size_t tables) {
+        TABLES = tables;
+      }
+
+      void batch(size_t batch) {
+        BATCH = batch;
+      }
+
+      void cache(size_t entries) {
+        CACHE = entries;
+      }
+
+      // Each process places its shard on NUMA nodes, see Mine
+      void numa(bool numa) {
+        NUMA = numa;
+      }
+
+      void load_excludes(const std::string &path) {
+        EXCLUDES.push_back(path);
+      }
+
+      void clear_excludes() {
+        EXCLUDES.clear();
+      }
+
+      // Mine the query file by processes of all shards and merge their partial results ('<OUTPUT>.shard<N>.med') into '<OUTPUT>.med'
+      // NOTE: A single shard is the whole knowledge-base, so its result is written directly.
+      void select(const std::string &input, const std::string &output) {
+        std::string name = Mine::output_name(input, output);
+        std::vector<std::string> partials;
+        std::vector<pid_t> processes;
+        std::cout.flush();
+        std::cerr.flush();
+        for (size_t shard = 0; shard < SHARDS; ++shard) {
+          partials.push_back(SHARDS == 1 ? name : name + ".shard" + std::to_string(shard));
+          pid_t process = fork();
+          if (process == 0) {
+            int status = 0;
+            try {
+              run(shard, input, partials.back());
+            } catch (const common::exception::TitledException& e) {
+              std::cerr << "ERROR (shard " << shard << "): " << e.what() << std::endl;
+              status = 1;
+            } catch (const std::exception& e) {
+              std::cerr << "ERROR (shard " << shard << "): " << e.what() << std::endl;
+              status = 1;
+            }
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(status);
+          }
+          if (process < 0) {
+            for (auto processes_it = processes.begin(); processes_it != processes.end(); ++processes_it) {
+              waitpid(*processes_it, nullptr, 0);
+            }
+            throw common::exception::TitledException("It is not possible to start the process of shard " + std::to_string(shard));
+          }
+          processes.push_back(process);
+        }
+        bool failed = false;
+        for (auto processes_it = processes.begin(); processes_it != processes.end(); ++processes_it) {
+          int status;
+          if (waitpid(*processes_it, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = true;
+          }
+        }
+        for (auto partials_it = partials.begin(); partials_it != partials.end(); ++partials_it) {
+          *partials_it += ".med";
+        }
+        if (SHARDS == 1) {
+          partials.clear();
+        } else if (!failed) {
+          Mine::merge(partials, name + ".med");
+        }
+        for (auto partials_it = partials.begin(); partials_it != partials.end(); ++partials_it) {
+          common::filesystem::remove_file(*partials_it);
+        }
+        if (failed) {
+          throw common::exception::TitledException("Mining of the query file '" + input + "' failed in some of the shards");
+        }
+      }
+    };
+  }
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "index.h"
+#include "features.h"
+#include "knowledgebase.h"
+#include "mine.h"
+#include "../common/exception.h"
+#include "../common/filesystem.h"
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace inspire {
+  namespace backend {
+    // Incremental update of a knowledge-base created by inspire, so that it is not necessary to rebuild it when a few structures are added or removed.
+    // Identifiers of structural elements are line numbers in the index of the knowledge-base, hence structures are only appended:
+    // new structures get identifiers following the last line of the index and fingerprints of removed structures are kept in groups,
+    // only their identifiers are written into the tombstones file (see TOMBSTONES_FILE()) and they are skipped when the knowledge-base is loaded.
+    // NOTE: A structure that is already in the knowledge-base is replaced, i.e. the old one is removed and the new one is appended.
+    class KnowledgeBaseUpdate {
+      private:
+      // Root directory of the knowledge-base
+      const std::string KNOWLEDGE_BASE;
+      // Index and labels of structural elements of the knowledge-base
+      const std::string INDEX;
+      const std::string INTERFACES;
+      // Number of lines of the index, i.e. the last used identifier
+      uint32_t COUNT;
+      // Intervals of identifiers of proteins that are not removed
+      std::map<std::string, std::vector<std::pair<uint32_t, uint32_t> > > PROTEINS;
+
+      // Read intervals of identifiers of individual proteins from an index file, returns the number of lines
+      static uint32_t read_index(const std::string &path, std::map<std::string, std::vector<std::pair<uint32_t, uint32_t> > > &proteins) {
+        Index index(path);
+        if (!index.reset()) {
+          return 0;
+        }
+        std::string protein;
+        do {
+          if (protein != index.protein() || proteins[protein].empty()) {
+            protein = index.protein();
+            proteins[protein].push_back({index.index(), index.index()});
+          } else {
+            proteins[protein].back().second = index.index();
+          }
+        } while (index.next());
+        return index.index();
+      }
+
+      // Append fingerprints of a single file to the corresponding file of the knowledge-base with identifiers shifted by <offset>
+      void append_fingerprints(const std::string &input, const std::string &output, uint32_t offset) {
+        std::ifstream source(input, std::ios::in | std::ios::binary);
+        uint32_t length;
+        if (!source.read(reinterpret_cast<char *>(&length), sizeof(length))) {
+          throw common::exception::TitledException("It is not possible to read fingerprints file '" + input + "'");
+        }
+        std::ofstream target;
+        if (common::filesystem::exists(output)) {
+          std::ifstream header(output, std::ios::in | std::ios::binary);
+          uint32_t old_length;
+          if (!header.read(reinterpret_cast<char *>(&old_length), sizeof(old_length)) || old_length != length) {
+            throw common::exception::TitledException("Fingerprints in '" + input + "' and '" + output + "' have different lengths");
+          }
+          header.close();
+          target.open(output, std::ios::out | std::ios::binary | std::ios::app);
+        } else {
+          size_t separator = output.rfind(common::filesystem::directory_separator);
+          if (separator != output.npos && !common::filesystem::exists(output.substr(0, separator)) && !common::filesystem::create_directory_recursive(output.substr(0, separator))) {
+            throw common::exception::TitledException("It is not possible to create a directory structure '" + output.substr(0, separator) + "'");
+          }
+          target.open(output, std::ios::out | std::ios::binary);
+          target.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        }
+        if (!target.is_open()) {
+          throw common::exception::TitledException("It is not possible to write into fingerprints file '" + output + "'");
+        }
+        std::vector<char> fingerprint(length);
+        uint32_t id;
+        while (source.read(reinterpret_cast<char *>(&id), sizeof(id)) && (length == 0 || source.read(fingerprint.data(), length))) {
+          id += offset;
+          target.write(reinterpret_cast<const char*>(&id), sizeof(id));
+          target.write(fingerprint.data(), length);
+        }
+        target.flush();
+        target.close();
+      }
+
+      // Append labels of new structural elements with identifiers shifted by <offset>
+      void append_interfaces(const std::string &input, uint32_t offset) {
+        FeaturesReader source(input);
+        {
+          FeaturesReader target(INTERFACES);
+          bool same = source.size() == target.size();
+          for (size_t i = 0; same && i < source.size(); ++i) {
+            same = source.header(i) == target.header(i);
+          }
+          if (!same) {
+            throw common::exception::TitledException("Labels in '" + input + "' and '" + INTERFACES + "' have different columns");
+          }
+        }
+        std::ofstream target(INTERFACES, std::ios::out | std::ios::app);
+        // Identifier is written only if it does not follow the previous one, the first one is always written
+        size_t last = 0;
+        while (source.next_line()) {
+          for (size_t i = 0; i < source.size(); ++i) {
+            if (i > 0) {
+              target << '\t';
+            }
+            target << source.value(i);
+          }
+          if (last == 0 || ++last != source.index() + offset) {
+            last = source.index() + offset;
+            target << '\t' << last;
+          }
+          target << '\n';
+        }
+        target.flush();
+        target.close();
+      }
+
+      public:
+      // <index>, <interfaces> Names of the index and the labels of structural elements in the knowledge-base's directory
+      KnowledgeBaseUpdate(const std::string &knowledge_base, const std::string &index, const std::string &interfaces)
+          : KNOWLEDGE_BASE(common::filesystem::enclose_directory_name(knowledge_base)), INDEX(KNOWLEDGE_BASE + index), INTERFACES(KNOWLEDGE_BASE + interfaces) {
+        if (!common::filesystem::is_regular_file(INDEX)) {
+          throw common::exception::TitledException("The knowledge-base '" + KNOWLEDGE_BASE + "' has no index '" + INDEX + "', it was constructed by an older version and must be rebuilt");
+        }
+        COUNT = read_index(INDEX, PROTEINS);
+        std::ifstream tombstones(KNOWLEDGE_BASE + TOMBSTONES_FILE());
+        std::string line;
+        while (std::getline(tombstones, line)) {
+          std::stringstream parts(line);
+          std::string protein;
+          uint32_t first;
+          if (std::getline(parts, protein, '\t') && parts >> first) {
+            auto proteins_it = PROTEINS.find(protein);
+            if (proteins_it != PROTEINS.end()) {
+              auto &ranges = proteins_it->second;
+              for (size_t i = 0; i < ranges.size(); ++i) {
+                if (ranges[i].first == first) {
+                  ranges.erase(ranges.begin() + i);
+                  break;
+                }
+              }
+              if (ranges.empty()) {
+                PROTEINS.erase(proteins_it);
+              }
+            }
+          }
+        }
+      }
+
+      // Mark all structural elements of the protein as removed, returns the number of removed structural elements
+      size_t remove(const std::string &protein) {
+        auto proteins_it = PROTEINS.find(protein);
+        if (proteins_it == PROTEINS.end()) {
+          return 0;
+        }
+        size_t count = 0;
+        std::ofstream tombstones(KNOWLEDGE_BASE + TOMBSTONES_FILE(), std::ios::out | std::ios::app);
+        for (auto ranges_it = proteins_it->second.begin(); ranges_it != proteins_it->second.end(); ++ranges_it) {
+          tombstones << protein << '\t' << ranges_it->first << '\t' << ranges_it->second << '\n';
+          count += ranges_it->second - ranges_it->first + 1;
+        }
+        tombstones.flush();
+        tombstones.close();
+        PROTEINS.erase(proteins_it);
+        return count;
+      }
+
+      // Append structures processed by inspire in the same way as during the construction of the knowledge-base
+      // <index> Index of new structures
+      // <interfaces> Labels of new structural elements
+      // <fingerprints> Directory with fingerprints of new structural elements in the same layout as in the knowledge-base
+      // NOTE: The index is extended first, so an interrupted update can waste some identifiers, but never reuse them.
+      void append(const std::string &index, const std::string &interfaces, const std::string &fingerprints) {
+        std::map<std::string, std::vector<std::pair<uint32_t, uint32_t> > > proteins;
+        uint32_t count = read_index(index, proteins);
+        if (count == 0) {
+          return;
+        }
+        for (auto proteins_it = proteins.begin(); proteins_it != proteins.end(); ++proteins_it) {
+          remove(proteins_it->first);
+        }
+        uint32_t offset = COUNT;
+
+        {
+          std::ifstream source(index);
+          std::ofstream target(INDEX, std::ios::out | std::ios::app);
+          target << source.rdbuf();
+          target.flush();
+          target.close();
+        }
+        COUNT += count;
+        for (auto proteins_it = proteins.begin(); proteins_it != proteins.end(); ++proteins_it) {
+          auto &ranges = PROTEINS[proteins_it->first];
+          for (auto ranges_it = proteins_it->second.begin(); ranges_it != proteins_it->second.end(); ++ranges_it) {
+            ranges.push_back({ranges_it->first + offset, ranges_it->second + offset});
+          }
+        }
+
+        append_interfaces(interfaces, offset);
+
+        common::filesystem::RecursiveDirectoryFileIterator file_iterator(fingerprints);
+        if (file_iterator.has_file()) {
+          do {
+            if (!common::filesystem::is_regular_file(file_iterator.filename()) || !common::string::ends_with(file_iterator.filename(), ".fin")) {
+              continue;
+            }
+            append_fingerprints(file_iterator.filename(), KNOWLEDGE_BASE + common::filesystem::relative(file_iterator.filename(), fingerprints), offset);
+          } while (file_iterator.has_next());
+        }
+      }
+
+      // Recompile the precompiled image of the knowledge-base (if there is any) for the same features of central residues
+      void compile(const std::string &image, size_t threads = 1) {
+        if (!common::filesystem::is_regular_file(image) || !KnowledgeBaseImage::is_image(image)) {
+          return;
+        }
+        std::set<std::string> filters = KnowledgeBaseImage(image).filters();
+        // The old image can be mapped by running processes, so it is replaced at once instead of being overwritten
+        std::string temporary = image + ".tmp";
+        Mine(KNOWLEDGE_BASE, filters, threads, 1).compile(temporary);
+        common::filesystem::move(temporary, image);
+      }
+
+      // Number of structural elements in the index including removed ones
+      uint32_t size() const {
+        return COUNT;
+      }
+    };
+  }
+}
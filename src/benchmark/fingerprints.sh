@@ -0,0 +1,59 @@
+#!/bin/bash
+# Times the construction of fingerprints of 'examples/queries' with settings of 'examples/fingerprints',
+# and with the same settings without edge properties, i.e. the lower bound of the rest of the construction,
+# so their difference is the cost of shortest paths in subgraphs.
+#
+# Usage: fingerprints.sh <INSPIRE> <FINGERPRINTS> [<BASELINE-FINGERPRINTS>]
+#   <INSPIRE>                Binary used to prepare the index, features and subgraphs of 'examples/queries'
+#   <FINGERPRINTS>           Binary whose construction of fingerprints is timed
+#   <BASELINE-FINGERPRINTS>  Binary built from another revision, e.g. from 24bf975^ to compare with Floyd-Warshall;
+#                            it is timed on the same input and its fingerprints must be the same
+# The median of RUNS runs (5 by default) is reported.
+
+set -e
+
+if [ $# -lt 2 ]; then
+  sed -n '2,11p' "$0" | cut -c3-
+  exit 1
+fi
+INSPIRE=$(realpath "$1")
+FINGERPRINTS=$(realpath "$2")
+BASELINE=
+if [ $# -ge 3 ]; then
+  BASELINE=$(realpath "$3")
+fi
+RUNS=${RUNS:-5}
+EXAMPLES=$(cd "$(dirname "$0")/../../examples" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+if ! "$INSPIRE" -s "$EXAMPLES/queries" -x"$WORK/subgraphs/" -k"$WORK/kb/" -m > "$WORK/inspire.log" 2>&1; then
+  cat "$WORK/inspire.log" >&2
+  exit 1
+fi
+SUBGRAPHS="$WORK/subgraphs"
+SETTINGS="$EXAMPLES/fingerprints/settings.json"
+sed 's/"edge":\[[^]]*\]/"edge":[]/' "$SETTINGS" > "$WORK/no-edges.json"
+
+# Median time of constructing fingerprints into <OUTPUT> by <BINARY> with <SETTINGS-FILE>
+measure() {
+  local times=()
+  for run in $(seq "$RUNS"); do
+    rm -rf "$3"
+    TIMEFORMAT=%R
+    times+=($( { time "$1" k "$3/" "$2" "$SUBGRAPHS/residues.ind" "$SUBGRAPHS/nodes.sup" "$SUBGRAPHS/edges.sup" "$SUBGRAPHS/features.tur" > /dev/null 2>&1; } 2>&1 ))
+  done
+  printf '%s\n' "${times[@]}" | sort -n | sed -n "$(( (RUNS + 1) / 2 ))p"
+}
+
+echo -e "fingerprints\tsettings\tsubgraphs\tmedian_seconds"
+SUBGRAPHS_COUNT=$(wc -l < "$SUBGRAPHS/nodes.sup")
+echo -e "$FINGERPRINTS\tdistance\t$SUBGRAPHS_COUNT\t$(measure "$FINGERPRINTS" "$SETTINGS" "$WORK/current")"
+echo -e "$FINGERPRINTS\tno-edges\t$SUBGRAPHS_COUNT\t$(measure "$FINGERPRINTS" "$WORK/no-edges.json" "$WORK/lower-bound")"
+if [ -n "$BASELINE" ]; then
+  echo -e "$BASELINE\tdistance\t$SUBGRAPHS_COUNT\t$(measure "$BASELINE" "$SETTINGS" "$WORK/baseline")"
+  if ! diff -r -q "$WORK/current" "$WORK/baseline" > /dev/null; then
+    echo "Fingerprints of '$BASELINE' differ" >&2
+    exit 2
+  fi
+fi
@@ -0,0 +1,185 @@
+// hamming.cpp : Microbenchmark of kernels computing Hamming distances of fingerprints.
+//
+
+#include "../common/hamming.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+void help() {
+  std::cout << "Help\n\n";
+
+  std::cout << "Compare a few query fingerprints with every fingerprint of knowledge-base files by all Hamming distance kernels supported by the processor,\n";
+  std::cout << "i.e. by the lookup of bytes in std::map used before the kernels, and by 'portable', 'popcnt', 'avx2' and 'avx512' implementations\n";
+  std::cout << "for a pair of fingerprints ('pair'), a block of consecutive fingerprints ('block') and fingerprints interleaved by 'pack' ('packed').\n";
+  std::cout << "A row with the time per compared pair and the sum of all distances (the same for all kernels) is written for each file and kernel.\n\n";
+
+  std::cout << "Usage:\t[-q <QUERIES>] [-r <ROUNDS>] <FINGERPRINTS-FILE>+\n";
+  std::cout << "      \t-h\n\n";
+
+  std::cout << "Options:\t-q <QUERIES>          \tNumber of queries taken evenly from each file. Default value is 64.\n";
+  std::cout << "        \t-r <ROUNDS>           \tHow many times all queries are compared, the fastest round is reported. Default value is 5.\n";
+  std::cout << "        \t<FINGERPRINTS-FILE>   \tA '.fin' file of a knowledge-base, e.g. from 'examples/fingerprints'.\n";
+  std::cout << "        \t-h                    \tShow informations about the program\n\n";
+}
+
+// Fingerprints of a knowledge-base file padded to a multiple of 8 bytes and stored consecutively, the same way as a mine stores a group
+struct Fingerprints {
+  size_t LENGTH;
+  size_t STRIDE;
+  size_t COUNT;
+  std::string DATA;
+};
+
+bool load(const std::string &path, Fingerprints &fingerprints) {
+  std::ifstream input(path, std::ios::in | std::ios::binary);
+  uint32_t length;
+  if (!input.read(reinterpret_cast<char *>(&length), sizeof(length))) {
+    return false;
+  }
+  fingerprints.LENGTH = length;
+  fingerprints.STRIDE = (length + 7) / 8 * 8;
+  fingerprints.COUNT = 0;
+  fingerprints.DATA.clear();
+  std::string buffer(length, '\0');
+  int32_t id;
+  while (input.read(reinterpret_cast<char *>(&id), sizeof(id)) && (length == 0 || input.read(&buffer[0], length))) {
+    fingerprints.DATA += buffer;
+    fingerprints.DATA.append(fingerprints.STRIDE - length, '\0');
+    ++fingerprints.COUNT;
+  }
+  return fingerprints.COUNT > 0;
+}
+
+// Run <rounds> times all queries and return the fastest round in nanoseconds per compared pair; distances are summed into <checksum>
+template<typename F>
+double measure(size_t rounds, size_t queries, size_t count, F compare, long long &checksum) {
+  double best = 0;
+  for (size_t round = 0; round < rounds; ++round) {
+    long long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t query = 0; query < queries; ++query) {
+      sum += compare(query);
+    }
+    double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (round == 0 || nanoseconds < best) {
+      best = nanoseconds;
+    }
+    checksum = sum;
+  }
+  return best / (queries * count);
+}
+
+int main(int argc, const char** argv) {
+  if (argc <= 1 || std::string(argv[1]) == "-h") {
+    help();
+    return 0;
+  }
+  size_t queries = 64;
+  size_t rounds = 5;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    std::string argument(argv[i]);
+    if (argument == "-q" || argument == "-r") {
+      if (++i >= argc || std::stoi(argv[i]) < 1) {
+        std::cerr << "Error: A positive number must follow '" << argument << "'";
+        help();
+        return 1;
+      }
+      (argument == "-q" ? queries : rounds) = std::stoi(argv[i]);
+    } else {
+      files.push_back(argument);
+    }
+  }
+
+  // Implementations in the order of 'common::hamming::best()', only those up to the best one can run on this processor
+  std::vector<std::string> implementations = {"portable", "popcnt", "avx2", "avx512"};
+  implementations.erase(std::find(implementations.begin(), implementations.end(), common::hamming::best()) + 1, implementations.end());
+  // Distances of bytes as they were looked up before the kernels
+  std::map<int, int> bytes;
+  bytes[0] = 0;
+  for (int i = 1; i < 256; i *= 2) {
+    for (int j = 0; j < i; j++) {
+      bytes[i + j] = bytes[j] + 1;
+    }
+  }
+
+  std::cout << "file\tbytes\tfingerprints\tqueries\tkernel\tns_per_pair\tchecksum\n";
+  for (auto files_it = files.begin(); files_it != files.end(); ++files_it) {
+    Fingerprints fingerprints;
+    if (!load(*files_it, fingerprints)) {
+      std::cerr << "Skipped '" << *files_it << "': it is not possible to read any fingerprint from it" << std::endl;
+      continue;
+    }
+    const size_t stride = fingerprints.STRIDE;
+    const size_t count = fingerprints.COUNT;
+    const char *data = fingerprints.DATA.data();
+    std::vector<const char *> picked;
+    // Queries as 64-bit words for packed kernels
+    std::vector<uint64_t> words(queries * (stride / 8));
+    for (size_t i = 0; i < queries; i++) {
+      picked.push_back(data + (i * count / queries) * stride);
+      std::memcpy(words.data() + i * (stride / 8), picked.back(), stride);
+    }
+    std::vector<int> distances(count + common::hamming::LANES);
+    std::vector<uint64_t> packed((count + common::hamming::LANES - 1) / common::hamming::LANES * common::hamming::LANES * (stride / 8));
+    common::hamming::pack(data, stride, count, packed.data());
+    auto report = [&](const std::string &kernel, double nanoseconds, long long checksum) {
+      std::cout << *files_it << '\t' << fingerprints.LENGTH << '\t' << count << '\t' << queries << '\t' << kernel << '\t' << nanoseconds << '\t' << checksum << '\n';
+    };
+
+    long long checksum = 0;
+    double nanoseconds = measure(rounds, queries, count, [&](size_t query) {
+      long long sum = 0;
+      for (size_t i = 0; i < count; i++) {
+        const char *fingerprint = data + i * stride;
+        for (size_t j = 0; j < fingerprints.LENGTH; j++) {
+          sum += bytes[(unsigned char)(picked[query][j] ^ fingerprint[j])];
+        }
+      }
+      return sum;
+    }, checksum);
+    report("map", nanoseconds, checksum);
+    for (auto implementations_it = implementations.begin(); implementations_it != implementations.end(); ++implementations_it) {
+      common::hamming::distance_function distance = common::hamming::select(*implementations_it);
+      nanoseconds = measure(rounds, queries, count, [&](size_t query) {
+        long long sum = 0;
+        for (size_t i = 0; i < count; i++) {
+          sum += distance(picked[query], data + i * stride, stride);
+        }
+        return sum;
+      }, checksum);
+      report(*implementations_it + "/pair", nanoseconds, checksum);
+
+      common::hamming::block_function block = common::hamming::select_block(*implementations_it);
+      nanoseconds = measure(rounds, queries, count, [&](size_t query) {
+        block(picked[query], data, stride, count, distances.data());
+        long long sum = 0;
+        for (size_t i = 0; i < count; i++) {
+          sum += distances[i];
+        }
+        return sum;
+      }, checksum);
+      report(*implementations_it + "/block", nanoseconds, checksum);
+
+      common::hamming::packed_function interleaved = common::hamming::select_packed(*implementations_it);
+      nanoseconds = measure(rounds, queries, count, [&](size_t query) {
+        interleaved(packed.data(), stride / 8, (count + common::hamming::LANES - 1) / common::hamming::LANES,
+                    words.data() + query * (stride / 8), distances.data());
+        long long sum = 0;
+        for (size_t i = 0; i < count; i++) {
+          sum += distances[i];
+        }
+        return sum;
+      }, checksum);
+      report(*implementations_it + "/packed", nanoseconds, checksum);
+    }
+  }
+  return 0;
+}
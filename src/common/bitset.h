@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace common {
+  namespace bitset {
+    static const size_t WORD_BITS = 64;
+
+    // Number of 64-bit words needed to store <bits> bits
+    inline size_t words(size_t bits) {
+      return (bits + WORD_BITS - 1) / WORD_BITS;
+    }
+
+    // Bits packed into 64-bit words, the i-th bit is the (i%64)-th bit of the (i/64)-th word and unused bits of the last word are zero.
+    // NOTE: Fingerprints are only set bit by bit and then copied out by bytes(), thus there are no word-wise OR or popcount operations;
+    //       fingerprints of a knowledge-base are compared by the kernels in hamming.h on their byte form.
+    class Bitset {
+      private:
+      size_t SIZE;
+      std::vector<uint64_t> WORDS;
+
+      public:
+      Bitset() : SIZE(0) { }
+      // All bits are zero
+      explicit Bitset(size_t size) : SIZE(size), WORDS(words(size), 0) { }
+
+      // Number of bits
+      size_t size() const {
+        return SIZE;
+      }
+
+      bool test(size_t index) const {
+        return (WORDS[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
+      }
+
+      void set(size_t index) {
+        WORDS[index / WORD_BITS] |= (uint64_t)1 << (index % WORD_BITS);
+      }
+
+      // Number of bytes needed to store the bits
+      size_t bytes() const {
+        return (SIZE + CHAR_BIT - 1) / CHAR_BIT;
+      }
+
+      // Write the bits as <length> bytes, the i-th bit is the (i%8)-th bit of the (i/8)-th byte (i.e. the format of knowledge-bases);
+      // bytes beyond the size are zero
+      void bytes(char *target, size_t length) const {
+        size_t stored = std::min(length, WORDS.size() * sizeof(uint64_t));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        std::memcpy(target, WORDS.data(), stored);
+#else
+        for (size_t i = 0; i < stored; ++i) {
+          target[i] = (char)(WORDS[i / sizeof(uint64_t)] >> (CHAR_BIT * (i % sizeof(uint64_t))));
+        }
+#endif // __BYTE_ORDER__
+        std::memset(target + stored, 0, length - stored);
+      }
+    };
+  }
+}
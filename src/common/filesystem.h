@@ -84,6 +84,11 @@ namespace common {
       boost::filesystem::remove(file);
     }
 
+    // Size of a regular file in bytes
+    inline uintmax_t file_size(std::string file) {
+      return boost::filesystem::file_size(file);
+    }
+
     // Check, whether <path> ends with file or directory name (separator); in the second case, add the <filename>.
     // Then check, whether path ends with <extension> - if not, add the extension.
     // NOTE: To consider path as a directory, it must end with a directory separator, otherwise an extension is added only.
@@ -1,32 +1,55 @@
 #pragma once
 
-#include <boost/graph/undirected_graph.hpp>
-#include <boost/graph/exterior_property.hpp>
-#include <boost/graph/floyd_warshall_shortest.hpp>
 #include "boost/property_tree/ptree.hpp"
 #include "boost/property_tree/json_parser.hpp"
+#include <utility>
+#include <vector>
 
 namespace common {
   namespace graph {
-    typedef boost::property<boost::edge_weight_t, int> edge_weight_property;
-    typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::undirectedS, boost::no_property, edge_weight_property> undirected_graph;
-    typedef boost::exterior_vertex_property<undirected_graph, int> distance_property;
-    typedef distance_property::matrix_type distance_matrix;
-    typedef distance_property::matrix_map_type distance_matrix_map;
-    typedef boost::constant_property_map<boost::graph_traits<undirected_graph>::edge_descriptor, int> const_property_map;
-    typedef boost::adjacency_list<>::vertex_descriptor vertex;
     typedef boost::property_tree::ptree property_tree;
 
-    vertex add_vertex(undirected_graph &g) {
-      return boost::add_vertex(g);
-    }
+    // Distance of vertices from different components
+    static const int UNREACHABLE = -1;
 
-    void add_edge(vertex &v1, vertex &v2, undirected_graph &g) {
-      boost::add_edge(v1, v2, g);
-    }
+    // All-pairs shortest paths of an unweighted undirected graph by a breadth-first search from each vertex,
+    // i.e. O(V*(V+E)) instead of O(V^3) of Floyd-Warshall, which pays off for small sparse graphs such as subgraphs of residues.
+    // <count> Number of vertices, they are numbered from 0
+    // <edges> Pairs of vertices
+    // <distances> Distance of each pair of vertices stored as [from * count + to]
+    inline void shortest_paths(size_t count, const std::vector<std::pair<int, int> > &edges, std::vector<int> &distances) {
+      // Adjacency lists in a single array, neighbours of the vertex v are [first[v]; first[v+1])
+      std::vector<int> first(count + 1, 0);
+      for (auto edges_it = edges.begin(); edges_it != edges.end(); ++edges_it) {
+        ++first[edges_it->first + 1];
+        ++first[edges_it->second + 1];
+      }
+      for (size_t v = 1; v <= count; ++v) {
+        first[v] += first[v - 1];
+      }
+      std::vector<int> neighbours(first[count]);
+      std::vector<int> next(first.begin(), first.end() - 1);
+      for (auto edges_it = edges.begin(); edges_it != edges.end(); ++edges_it) {
+        neighbours[next[edges_it->first]++] = edges_it->second;
+        neighbours[next[edges_it->second]++] = edges_it->first;
+      }
 
-    void shortest_paths(undirected_graph &g, distance_matrix_map &distances, const_property_map &properties) {
-      boost::floyd_warshall_all_pairs_shortest_paths(g, distances, boost::weight_map(properties));
+      distances.assign(count * count, UNREACHABLE);
+      std::vector<int> queue(count);
+      for (size_t source = 0; source < count; ++source) {
+        int *row = distances.data() + source * count;
+        row[source] = 0;
+        queue[0] = source;
+        for (size_t head = 0, tail = 1; head < tail; ++head) {
+          int vertex = queue[head];
+          for (int i = first[vertex]; i < first[vertex + 1]; ++i) {
+            if (row[neighbours[i]] == UNREACHABLE) {
+              row[neighbours[i]] = row[vertex] + 1;
+              queue[tail++] = neighbours[i];
+            }
+          }
+        }
+      }
     }
 
     void parse_json(const std::string &path, property_tree &root) {
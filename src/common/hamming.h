@@ -0,0 +1,300 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAMMING_X86
+#endif // __GNUC__ && x86
+
+namespace common {
+  namespace hamming {
+    // Signature of a function computing the Hamming distance of two fingerprints with the same length in bytes
+    typedef int (*distance_function)(const char *left, const char *right, size_t length);
+    // Signature of a function computing distances of a query and <count> consecutive fingerprints placed <stride> bytes apart
+    typedef void (*block_function)(const char *query, const char *fingerprints, size_t stride, size_t count, int *distances);
+    // Signature of a function computing distances of a query (as <words> 64-bit words) and <groups> * LANES fingerprints packed by 'pack'
+    typedef void (*packed_function)(const uint64_t *packed, size_t words, size_t groups, const uint64_t *query, int *distances);
+
+    // Number of fingerprints whose words are interleaved in a packed block
+    static const size_t LANES = 8;
+
+    // Load a 64-bit word from an arbitrary (i.e. possibly unaligned) address
+    inline uint64_t load_word(const char *address) {
+      uint64_t word;
+      std::memcpy(&word, address, sizeof(word));
+      return word;
+    }
+
+    // Number of bits set to one in the word without any special instruction
+    inline int popcount_portable(uint64_t word) {
+      word = word - ((word >> 1) & 0x5555555555555555ULL);
+      word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+      word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+      return (int)((word * 0x0101010101010101ULL) >> 56);
+    }
+
+    // Fallback usable on any platform: fingerprints are compared as 64-bit words
+    inline int distance_portable(const char *left, const char *right, size_t length) {
+      int distance = 0;
+      size_t i = 0;
+      for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        distance += popcount_portable(load_word(left + i) ^ load_word(right + i));
+      }
+      for (; i < length; ++i) {
+        distance += popcount_portable((unsigned char)(left[i] ^ right[i]));
+      }
+      return distance;
+    }
+
+    inline void block_portable(const char *query, const char *fingerprints, size_t stride, size_t count, int *distances) {
+      for (size_t i = 0; i < count; ++i) {
+        distances[i] = distance_portable(query, fingerprints + i * stride, stride);
+      }
+    }
+
+    // Interleave words of <count> fingerprints (stride is a multiple of 8 bytes), i.e. the i-th word of LANES consecutive fingerprints is stored together,
+    // so distances of LANES fingerprints are computed at once without horizontal sums; the last group is padded with zeros
+    inline void pack(const char *fingerprints, size_t stride, size_t count, uint64_t *packed) {
+      size_t words = stride / sizeof(uint64_t);
+      size_t groups = (count + LANES - 1) / LANES;
+      for (size_t g = 0; g < groups; ++g) {
+        for (size_t lane = 0; lane < LANES; ++lane) {
+          size_t i = g * LANES + lane;
+          for (size_t w = 0; w < words; ++w) {
+            packed[(g * words + w) * LANES + lane] = i < count ? load_word(fingerprints + i * stride + w * sizeof(uint64_t)) : 0;
+          }
+        }
+      }
+    }
+
+    inline void packed_portable(const uint64_t *packed, size_t words, size_t groups, const uint64_t *query, int *distances) {
+      for (size_t g = 0; g < groups; ++g) {
+        for (size_t lane = 0; lane < LANES; ++lane) {
+          int distance = 0;
+          for (size_t w = 0; w < words; ++w) {
+            distance += popcount_portable(packed[(g * words + w) * LANES + lane] ^ query[w]);
+          }
+          distances[g * LANES + lane] = distance;
+        }
+      }
+    }
+
+    // Number of bits set to one in the fingerprint
+    inline int popcount(const char *fingerprint, size_t length) {
+      int count = 0;
+      size_t i = 0;
+      for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        count += popcount_portable(load_word(fingerprint + i));
+      }
+      for (; i < length; ++i) {
+        count += popcount_portable((unsigned char)fingerprint[i]);
+      }
+      return count;
+    }
+
+#ifdef HAMMING_X86
+    // 64-bit words with hardware popcount
+    __attribute__((target("popcnt")))
+    inline int distance_popcnt(const char *left, const char *right, size_t length) {
+      int distance = 0;
+      size_t i = 0;
+      for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        distance += __builtin_popcountll(load_word(left + i) ^ load_word(right + i));
+      }
+      for (; i < length; ++i) {
+        distance += __builtin_popcount((unsigned char)(left[i] ^ right[i]));
+      }
+      return distance;
+    }
+
+    // 32-byte blocks with a nibble lookup table (AVX2 has no vector popcount instruction)
+    __attribute__((target("avx2,popcnt")))
+    inline int distance_avx2(const char *left, const char *right, size_t length) {
+      const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                             0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+      const __m256i low_mask = _mm256_set1_epi8(0x0F);
+      __m256i sums = _mm256_setzero_si256();
+      size_t i = 0;
+      for (; i + sizeof(__m256i) <= length; i += sizeof(__m256i)) {
+        __m256i bits = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i)),
+                                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i)));
+        __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(bits, low_mask)),
+                                         _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(bits, 4), low_mask)));
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+      }
+      int distance = (int)(_mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) + _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3));
+      return distance + distance_popcnt(left + i, right + i, length - i);
+    }
+
+    // 64-byte blocks with a vector popcount, the tail is loaded with a mask
+    __attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+    inline int distance_avx512(const char *left, const char *right, size_t length) {
+      __m512i sums = _mm512_setzero_si512();
+      size_t i = 0;
+      for (; i + sizeof(__m512i) <= length; i += sizeof(__m512i)) {
+        __m512i bits = _mm512_xor_si512(_mm512_loadu_si512(left + i), _mm512_loadu_si512(right + i));
+        sums = _mm512_add_epi64(sums, _mm512_popcnt_epi64(bits));
+      }
+      if (i < length) {
+        __mmask64 mask = ~0ULL >> (sizeof(__m512i) - (length - i));
+        __m512i bits = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask, left + i), _mm512_maskz_loadu_epi8(mask, right + i));
+        sums = _mm512_add_epi64(sums, _mm512_popcnt_epi64(bits));
+      }
+      // Lanes are summed through memory, _mm512_reduce_add_epi64 (like _mm512_cvtepi64_epi32) trips -Wmaybe-uninitialized in GCC 12
+      alignas(64) uint64_t lanes[sizeof(__m512i) / sizeof(uint64_t)];
+      _mm512_store_si512(lanes, sums);
+      uint64_t distance = 0;
+      for (size_t lane = 0; lane < sizeof(__m512i) / sizeof(uint64_t); ++lane) {
+        distance += lanes[lane];
+      }
+      return (int)distance;
+    }
+
+    // Block variants are compiled for the same target as the kernels, so the kernels are inlined into them
+    __attribute__((target("popcnt")))
+    inline void block_popcnt(const char *query, const char *fingerprints, size_t stride, size_t count, int *distances) {
+      for (size_t i = 0; i < count; ++i) {
+        distances[i] = distance_popcnt(query, fingerprints + i * stride, stride);
+      }
+    }
+
+    __attribute__((target("popcnt")))
+    inline void packed_popcnt(const uint64_t *packed, size_t words, size_t groups, const uint64_t *query, int *distances) {
+      for (size_t g = 0; g < groups; ++g) {
+        for (size_t lane = 0; lane < LANES; ++lane) {
+          int distance = 0;
+          for (size_t w = 0; w < words; ++w) {
+            distance += __builtin_popcountll(packed[(g * words + w) * LANES + lane] ^ query[w]);
+          }
+          distances[g * LANES + lane] = distance;
+        }
+      }
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    inline void block_avx2(const char *query, const char *fingerprints, size_t stride, size_t count, int *distances) {
+      for (size_t i = 0; i < count; ++i) {
+        distances[i] = distance_avx2(query, fingerprints + i * stride, stride);
+      }
+    }
+
+    // Two halves of a group (4 lanes each), the per-lane sum of byte counts is exactly the distance of a lane
+    __attribute__((target("avx2,popcnt")))
+    inline void packed_avx2(const uint64_t *packed, size_t words, size_t groups, const uint64_t *query, int *distances) {
+      const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                             0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+      const __m256i low_mask = _mm256_set1_epi8(0x0F);
+      for (size_t g = 0; g < groups; ++g) {
+        for (size_t half = 0; half < LANES; half += 4) {
+          __m256i sums = _mm256_setzero_si256();
+          for (size_t w = 0; w < words; ++w) {
+            __m256i bits = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(packed + (g * words + w) * LANES + half)),
+                                            _mm256_set1_epi64x((long long)query[w]));
+            __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(bits, low_mask)),
+                                             _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(bits, 4), low_mask)));
+            sums = _mm256_add_epi64(sums, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+          }
+          uint64_t lanes[4];
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sums);
+          for (size_t lane = 0; lane < 4; ++lane) {
+            distances[g * LANES + half + lane] = (int)lanes[lane];
+          }
+        }
+      }
+    }
+
+    __attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+    inline void packed_avx512(const uint64_t *packed, size_t words, size_t groups, const uint64_t *query, int *distances) {
+      for (size_t g = 0; g < groups; ++g) {
+        __m512i sums = _mm512_setzero_si512();
+        for (size_t w = 0; w < words; ++w) {
+          __m512i bits = _mm512_xor_si512(_mm512_loadu_si512(packed + (g * words + w) * LANES), _mm512_set1_epi64((long long)query[w]));
+          sums = _mm512_add_epi64(sums, _mm512_popcnt_epi64(bits));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(distances + g * LANES), _mm512_maskz_cvtepi64_epi32(0xFF, sums));
+      }
+    }
+
+    __attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+    inline void block_avx512(const char *query, const char *fingerprints, size_t stride, size_t count, int *distances) {
+      for (size_t i = 0; i < count; ++i) {
+        distances[i] = distance_avx512(query, fingerprints + i * stride, stride);
+      }
+    }
+#endif // HAMMING_X86
+
+    // Name of the best implementation supported by the current processor
+    inline std::string best() {
+#ifdef HAMMING_X86
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vpopcntdq")) {
+        return "avx512";
+      }
+      if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return "avx2";
+      }
+      if (__builtin_cpu_supports("popcnt")) {
+        return "popcnt";
+      }
+#endif // HAMMING_X86
+      return "portable";
+    }
+
+    // Implementation with the given name; unknown names and implementations not supported by the compiler result in the portable one
+    inline distance_function select(const std::string &name) {
+#ifdef HAMMING_X86
+      if (name == "avx512") {
+        return &distance_avx512;
+      }
+      if (name == "avx2") {
+        return &distance_avx2;
+      }
+      if (name == "popcnt") {
+        return &distance_popcnt;
+      }
+#endif // HAMMING_X86
+      return &distance_portable;
+    }
+
+    // Block variant of the implementation with the given name
+    inline block_function select_block(const std::string &name) {
+#ifdef HAMMING_X86
+      if (name == "avx512") {
+        return &block_avx512;
+      }
+      if (name == "avx2") {
+        return &block_avx2;
+      }
+      if (name == "popcnt") {
+        return &block_popcnt;
+      }
+#endif // HAMMING_X86
+      return &block_portable;
+    }
+
+    // Packed variant of the implementation with the given name
+    inline packed_function select_packed(const std::string &name) {
+#ifdef HAMMING_X86
+      if (name == "avx512") {
+        return &packed_avx512;
+      }
+      if (name == "avx2") {
+        return &packed_avx2;
+      }
+      if (name == "popcnt") {
+        return &packed_popcnt;
+      }
+#endif // HAMMING_X86
+      return &packed_portable;
+    }
+
+    // Implementation chosen once at start-up according to the current processor
+    static const distance_function distance = select(best());
+    static const block_function block = select_block(best());
+    static const packed_function packed = select_packed(best());
+  }
+}
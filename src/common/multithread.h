@@ -1,9 +1,191 @@
 #pragma once
 
 #include "boost/thread/sync_queue.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace common {
   namespace multithread {
     typedef boost::sync_queue<std::string> synchronized_queue;
+
+    // Hands out tasks to parallel workers in their order and returns results of the tasks in the same order.
+    // A worker cannot take a task too far ahead of the first result that was not returned yet, so only a bounded number of results is buffered.
+    template<typename T>
+    class BasicReorderBuffer {
+      private:
+      std::mutex MUTEX;
+      std::condition_variable CHANGED;
+      // Number of tasks, it can be unknown in advance until the buffer is closed
+      size_t COUNT;
+      // How many tasks can be taken ahead of the first result that was not returned yet
+      const size_t WINDOW;
+      // The next task to take and the next result to return
+      size_t TAKEN;
+      size_t RETURNED;
+      // Finished results that cannot be returned yet
+      std::map<size_t, T> FINISHED;
+
+      public:
+      BasicReorderBuffer(size_t count, size_t window) : COUNT(count), WINDOW(std::max(window, (size_t)1)), TAKEN(0), RETURNED(0) { }
+      // The number of tasks is not known yet, see close()
+      BasicReorderBuffer(size_t window) : BasicReorderBuffer(SIZE_MAX, window) { }
+
+      // There are only <count> tasks, i.e. the rest of taken tasks are not finished
+      void close(size_t count) {
+        {
+          std::lock_guard<std::mutex> lock(MUTEX);
+          COUNT = std::min(COUNT, count);
+        }
+        CHANGED.notify_all();
+      }
+
+      // Take the next task, returns false if all tasks were taken
+      bool take(size_t &task) {
+        std::unique_lock<std::mutex> lock(MUTEX);
+        CHANGED.wait(lock, [this]() { return TAKEN >= COUNT || TAKEN < RETURNED + WINDOW; });
+        if (TAKEN >= COUNT) {
+          return false;
+        }
+        task = TAKEN++;
+        return true;
+      }
+
+      // Store the result of a task, <result> is emptied
+      void finish(size_t task, T &result) {
+        {
+          std::lock_guard<std::mutex> lock(MUTEX);
+          std::swap(FINISHED[task], result);
+        }
+        CHANGED.notify_all();
+      }
+
+      // Wait for the result of the next task, returns false if all results were returned
+      bool next(T &result) {
+        std::unique_lock<std::mutex> lock(MUTEX);
+        CHANGED.wait(lock, [this]() { return RETURNED >= COUNT || FINISHED.find(RETURNED) != FINISHED.end(); });
+        if (RETURNED >= COUNT) {
+          return false;
+        }
+        auto finished_it = FINISHED.find(RETURNED);
+        std::swap(result, finished_it->second);
+        FINISHED.erase(finished_it);
+        ++RETURNED;
+        lock.unlock();
+        CHANGED.notify_all();
+        return true;
+      }
+    };
+    typedef BasicReorderBuffer<std::string> ReorderBuffer;
+
+    // A queue with a limited capacity between a producer and consumers, both sides wait if they cannot continue.
+    // The numbers of waits are counted to show whether producing or consuming is the bottleneck.
+    template<typename T>
+    class BoundedQueue {
+      private:
+      std::mutex MUTEX;
+      std::condition_variable NOT_EMPTY;
+      std::condition_variable NOT_FULL;
+      std::deque<T> ITEMS;
+      const size_t CAPACITY;
+      bool CLOSED;
+      // How many times the producer waited for a free place, and consumers waited for an item
+      size_t FULL_STALLS;
+      size_t EMPTY_STALLS;
+
+      public:
+      BoundedQueue(size_t capacity) : CAPACITY(std::max(capacity, (size_t)1)), CLOSED(false), FULL_STALLS(0), EMPTY_STALLS(0) { }
+
+      // Wait for a free place and insert the item
+      void push(T &&item) {
+        std::unique_lock<std::mutex> lock(MUTEX);
+        if (ITEMS.size() >= CAPACITY) {
+          ++FULL_STALLS;
+          NOT_FULL.wait(lock, [this]() { return ITEMS.size() < CAPACITY; });
+        }
+        ITEMS.push_back(std::move(item));
+        lock.unlock();
+        NOT_EMPTY.notify_one();
+      }
+
+      // Wait for an item, returns false if the queue is empty and closed
+      bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(MUTEX);
+        if (ITEMS.empty() && !CLOSED) {
+          ++EMPTY_STALLS;
+          NOT_EMPTY.wait(lock, [this]() { return !ITEMS.empty() || CLOSED; });
+        }
+        if (ITEMS.empty()) {
+          return false;
+        }
+        item = std::move(ITEMS.front());
+        ITEMS.pop_front();
+        lock.unlock();
+        NOT_FULL.notify_one();
+        return true;
+      }
+
+      // No more items will be pushed
+      void close() {
+        {
+          std::lock_guard<std::mutex> lock(MUTEX);
+          CLOSED = true;
+        }
+        NOT_EMPTY.notify_all();
+      }
+
+      size_t full_stalls() {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        return FULL_STALLS;
+      }
+
+      size_t empty_stalls() {
+        std::lock_guard<std::mutex> lock(MUTEX);
+        return EMPTY_STALLS;
+      }
+    };
+
+    // Run task(0) ... task(count-1) on the given number of threads, tasks are taken in their order.
+    // If a task throws, remaining tasks are skipped and the first exception is rethrown by the calling thread.
+    inline void parallel_for(size_t count, size_t threads, const std::function<void(size_t)> &task) {
+      std::atomic<size_t> next(0);
+      std::exception_ptr error;
+      std::mutex mutex;
+      auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < count) {
+          try {
+            task(i);
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+              error = std::current_exception();
+            }
+            next = count;
+          }
+        }
+      };
+      std::vector<std::thread> pool;
+      for (size_t i = 1; i < std::min(std::max(threads, (size_t)1), count); i++) {
+        pool.push_back(std::thread(worker));
+      }
+      worker();
+      for (auto pool_it = pool.begin(); pool_it != pool.end(); ++pool_it) {
+        pool_it->join();
+      }
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
   }
 }
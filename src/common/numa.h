@@ -0,0 +1,99 @@
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif // __linux__
+
+namespace common {
+  namespace numa {
+    // A NUMA node, i.e. CPUs with the same local memory
+    struct Node {
+      // Number of the node in the system
+      size_t ID;
+      // CPUs of the node that the process is allowed to run on, no CPU means that threads are not pinned
+      std::vector<int> CPUS;
+    };
+
+    // Parse a list in the format used by sysfs, e.g. '0-3,8,10-11'
+    inline std::vector<int> parse_list(const std::string &list) {
+      std::vector<int> result;
+      std::stringstream parts(list);
+      std::string part;
+      while (std::getline(parts, part, ',')) {
+        size_t dash = part.find('-');
+        try {
+          int first = std::stoi(part.substr(0, dash));
+          int last = (dash == part.npos ? first : std::stoi(part.substr(dash + 1)));
+          for (int i = first; i <= last; ++i) {
+            result.push_back(i);
+          }
+        } catch (const std::exception&) {
+          // An empty part (e.g. a trailing new line) or a malformed one
+        }
+      }
+      return result;
+    }
+
+    // Nodes with at least one CPU the process is allowed to run on, read from <root> (the sysfs directory of nodes).
+    // If the topology cannot be read (e.g. on other systems than Linux), a single node without CPUs is returned,
+    // so a machine without NUMA is handled in the same way as a single-node machine.
+    inline std::vector<Node> nodes(const std::string &root = "/sys/devices/system/node/") {
+      std::vector<Node> result;
+#ifdef __linux__
+      cpu_set_t allowed;
+      CPU_ZERO(&allowed);
+      bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+      std::ifstream online(root + "online");
+      std::string line;
+      if (std::getline(online, line)) {
+        std::vector<int> ids = parse_list(line);
+        for (auto ids_it = ids.begin(); ids_it != ids.end(); ++ids_it) {
+          std::ifstream cpulist(root + "node" + std::to_string(*ids_it) + "/cpulist");
+          if (!std::getline(cpulist, line)) {
+            continue;
+          }
+          Node node{(size_t)*ids_it, std::vector<int>()};
+          std::vector<int> cpus = parse_list(line);
+          for (auto cpus_it = cpus.begin(); cpus_it != cpus.end(); ++cpus_it) {
+            if (*cpus_it < CPU_SETSIZE && (!restricted || CPU_ISSET(*cpus_it, &allowed))) {
+              node.CPUS.push_back(*cpus_it);
+            }
+          }
+          // Memory-only nodes and nodes excluded by the affinity of the process are skipped
+          if (!node.CPUS.empty()) {
+            result.push_back(node);
+          }
+        }
+      }
+#endif // __linux__
+      if (result.empty()) {
+        result.push_back(Node{0, std::vector<int>()});
+      }
+      return result;
+    }
+
+    // Restrict the calling thread to CPUs of the node, so memory it touches first is allocated from the node.
+    // Threads created by the thread inherit the restriction. Returns false if the thread cannot be pinned.
+    inline bool pin(const Node &node) {
+#ifdef __linux__
+      if (node.CPUS.empty()) {
+        return false;
+      }
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      for (auto cpus_it = node.CPUS.begin(); cpus_it != node.CPUS.end(); ++cpus_it) {
+        CPU_SET(*cpus_it, &cpus);
+      }
+      return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+      return false;
+#endif // __linux__
+    }
+  }
+}
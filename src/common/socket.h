@@ -0,0 +1,47 @@
+#pragma once
+
+#include "exception.h"
+#include <boost/asio.hpp>
+#include <string>
+
+namespace common {
+  namespace socket {
+    // Either a TCP socket or a Unix domain socket
+    typedef boost::asio::generic::stream_protocol protocol;
+    typedef boost::asio::basic_socket_acceptor<protocol> acceptor;
+
+    // Endpoint given by a port number on the loopback interface, or by a path of a Unix domain socket
+    inline protocol::endpoint endpoint(const std::string &name) {
+      if (!name.empty() && name.find_first_not_of("0123456789") == name.npos) {
+        return protocol::endpoint(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), std::stoi(name)));
+      }
+      return protocol::endpoint(boost::asio::local::stream_protocol::endpoint(name));
+    }
+
+    // Read a line without the terminating new line character, return false if the connection was closed before
+    inline bool read_line(protocol::socket &socket, boost::asio::streambuf &buffer, std::string &line) {
+      boost::system::error_code error;
+      boost::asio::read_until(socket, buffer, '\n', error);
+      std::istream stream(&buffer);
+      if (error && buffer.size() == 0) {
+        return false;
+      }
+      std::getline(stream, line);
+      return true;
+    }
+
+    // Read exactly <size> bytes, part of them can be already in the buffer
+    inline std::string read(protocol::socket &socket, boost::asio::streambuf &buffer, size_t size) {
+      if (buffer.size() < size) {
+        boost::asio::read(socket, buffer, boost::asio::transfer_exactly(size - buffer.size()));
+      }
+      std::string content(boost::asio::buffers_begin(buffer.data()), boost::asio::buffers_begin(buffer.data()) + size);
+      buffer.consume(size);
+      return content;
+    }
+
+    inline void write(protocol::socket &socket, const std::string &content) {
+      boost::asio::write(socket, boost::asio::buffer(content));
+    }
+  }
+}
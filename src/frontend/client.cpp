@@ -0,0 +1,171 @@
+// client.cpp : Defines the entry point for the console application.
+//
+
+#include "../common/exception.h"
+#include "../common/socket.h"
+#include "../common/string.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+//#define TESTING
+
+void help() {
+  std::cout << "Help\n\n";
+
+  std::cout << "Send structures to a running inspire server and print the predicted interfaces,\n";
+  std::cout << "or repeatedly send the same request from several parallel connections and print statistics of latencies.\n\n";
+
+  std::cout << "Usage:\t[-c <CONNECTIONS>] [-r <REQUESTS>] [-f <FORMAT>] <ENDPOINT> <STRUCTURE>+\n";
+  std::cout << "      \t-h\n\n";
+
+  std::cout << "Options:\t-c <CONNECTIONS>  \tNumber of parallel connections. Default value is 1.\n";
+  std::cout << "        \t-r <REQUESTS>     \tNumber of requests sent over each connection. Default value is 1.\n";
+  std::cout << "        \t                  \tIf any of '-c' and '-r' switchers is used, statistics are printed instead of the predicted interfaces.\n";
+  std::cout << "        \t-f <FORMAT>       \tFile format of results: 'x' for XML, 'l' for the aligned list, or 'c<DELIMITER>' for delimiter-separated values.\n";
+  std::cout << "        \t                  \tIf no file format is specified, tab-separated values file format is used.\n";
+  std::cout << "        \t<ENDPOINT>        \tPort number on the loopback interface, or a path of a Unix domain socket the server listens on.\n";
+  std::cout << "        \t<STRUCTURE>       \tPath of a structure file or a directory on the machine running the server.\n";
+  std::cout << "        \t-h                \tShow informations about the program\n\n";
+}
+
+// Send a request over an open connection and return the output file, throw an exception in the case of an error
+std::string request(common::socket::protocol::socket &socket, boost::asio::streambuf &buffer, const std::string &line) {
+  common::socket::write(socket, line);
+  std::string header;
+  if (!common::socket::read_line(socket, buffer, header)) {
+    throw common::exception::TitledException("The server closed the connection");
+  }
+  if (common::string::starts_with(header, "OK\t")) {
+    return common::socket::read(socket, buffer, std::stoull(header.substr(3)));
+  }
+  throw common::exception::TitledException("The server responded '" + header + "'");
+}
+
+// Send <count> requests over a single connection and store latencies in microseconds
+void load(const common::socket::protocol::endpoint &endpoint, const std::string &line, size_t count,
+          std::vector<double> &latencies, size_t &errors, std::mutex &mutex) {
+  boost::asio::io_context context;
+  common::socket::protocol::socket socket(context);
+  boost::asio::streambuf buffer;
+  std::vector<double> local;
+  size_t failed = 0;
+  try {
+    socket.connect(endpoint);
+    for (size_t i = 0; i < count; i++) {
+      auto start = std::chrono::steady_clock::now();
+      try {
+        request(socket, buffer, line);
+        local.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+      } catch (const common::exception::TitledException& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        ++failed;
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    failed = count - local.size();
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  latencies.insert(latencies.end(), local.begin(), local.end());
+  errors += failed;
+}
+
+int main(int argc, const char** argv) {
+  if (argc <= 1 || common::string::starts_with(argv[1], "-h")) {
+    help();
+    return 0;
+  }
+
+  try {
+    size_t connections = 1;
+    size_t requests = 1;
+    bool statistics = false;
+    std::string format;
+    int argv_index = 1;
+    for (; argv_index < argc - 1 && strlen(argv[argv_index]) == 2 && argv[argv_index][0] == '-'; argv_index += 2) {
+      switch (argv[argv_index][1]) {
+        case 'c':
+          connections = std::max(std::stoi(argv[argv_index + 1]), 1);
+          statistics = true;
+          break;
+        case 'r':
+          requests = std::max(std::stoi(argv[argv_index + 1]), 1);
+          statistics = true;
+          break;
+        case 'f':
+          format = argv[argv_index + 1];
+          break;
+        default:
+          std::cerr << "Unknown switcher '" << argv[argv_index] << "'.\n";
+          return 1;
+      }
+    }
+    if (argc - argv_index < 2) {
+      std::cerr << "Missing endpoint or structures.\n";
+      return 2;
+    }
+    common::socket::protocol::endpoint endpoint = common::socket::endpoint(argv[argv_index]);
+    std::string line = format;
+    while (++argv_index < argc) {
+      line += '\t';
+      line += argv[argv_index];
+    }
+    line += '\n';
+
+    if (!statistics) {
+      boost::asio::io_context context;
+      common::socket::protocol::socket socket(context);
+      boost::asio::streambuf buffer;
+      socket.connect(endpoint);
+      std::cout << request(socket, buffer, line);
+      return 0;
+    }
+
+    std::vector<double> latencies;
+    size_t errors = 0;
+    std::mutex mutex;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < connections; i++) {
+      threads.push_back(std::thread(load, std::cref(endpoint), std::cref(line), requests, std::ref(latencies), std::ref(errors), std::ref(mutex)));
+    }
+    for (auto threads_it = threads.begin(); threads_it != threads.end(); ++threads_it) {
+      threads_it->join();
+    }
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "Requests\t" << latencies.size() + errors << '\n';
+    std::cout << "Errors\t" << errors << '\n';
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Time [s]\t" << total << '\n';
+    std::cout << "Throughput [1/s]\t" << latencies.size() / total << '\n';
+    if (!latencies.empty()) {
+      double sum = 0;
+      for (auto latencies_it = latencies.begin(); latencies_it != latencies.end(); ++latencies_it) {
+        sum += *latencies_it;
+      }
+      std::cout << "Mean [ms]\t" << sum / latencies.size() / 1000 << '\n';
+      std::cout << "Min [ms]\t" << latencies.front() / 1000 << '\n';
+      std::cout << "Median [ms]\t" << latencies[latencies.size() / 2] / 1000 << '\n';
+      std::cout << "90th percentile [ms]\t" << latencies[latencies.size() * 9 / 10] / 1000 << '\n';
+      std::cout << "99th percentile [ms]\t" << latencies[latencies.size() * 99 / 100] / 1000 << '\n';
+      std::cout << "Max [ms]\t" << latencies.back() / 1000 << '\n';
+    }
+    return errors == 0 ? 0 : 3;
+  } catch (const common::exception::TitledException& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 4;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 5;
+  } catch (...) {
+    std::cerr << "UNKNOWN ERROR" << std::endl;
+    return 6;
+  }
+}
@@ -13,7 +13,7 @@ void help() {
 
   std::cout << "Constructs fingerprints defined in settings for subgraphs specified in '.sup' files with features of nodes defined in '.tur' files.\n\n";
 
-  std::cout << "Usage:\t(k|q) <OUTPUT-PATH> <SETTINGS-FILE> <INDEX-FILE> <NODES-FILE> <EDGES-FILE> (<FEATURES-PATH>)*\n";
+  std::cout << "Usage:\t[-t<THREADS>] (k|q|p) <OUTPUT-PATH> <SETTINGS-FILE> <INDEX-FILE> <NODES-FILE> <EDGES-FILE> (<FEATURES-PATH>)*\n";
   std::cout << "      \t-h\n\n";
 
   std::cout << "Options:\t<INDEX-FILE>     \tPath to a index file\n";
@@ -22,16 +22,20 @@ void help() {
   std::cout << "        \t<OUTPUT-PATH>    \tWhere to store output file(s).\n";
   std::cout << "        \t                 \tWith 'q' switcher:\tIf <OUTPUT-PATH> is empty or ends with a directory separator, 'query.fit' is used as the file name.\n";
   std::cout << "        \t                 \t                  \tIf <OUTPUT-PATH> does not end with '.fit' extension, the extension is appended.\n";
+  std::cout << "        \t                 \tWith 'p' switcher:\tThe same as with 'q' switcher, but with 'query.fiq' and '.fiq' extension.\n";
   std::cout << "        \t                 \tWith 'k' switcher:\t<OUTPUT-PATH> is interpreted as a directory and fingerprints are separated in directories and\n";
   std::cout << "        \t                 \t                  \tfiles named after features of central residues with '.fin' as a file extension.\n";
   std::cout << "        \t                 \t                  \tOrder of directories hieararchy is the same as the order of features in FEATURES-PATHs.\n";
+  std::cout << "        \t-t<THREADS>      \tNumber of threads computing fingerprints. Default value is 1.\n";
+  std::cout << "        \t                 \tModels are computed in parallel, but fingerprints are written in the same order as with a single thread.\n";
   std::cout << "        \t-h               \tShow informations about the program\n";
   std::cout << "    Subgraphs Definition:\n";
   std::cout << "        \t<NODES-FILE>     \tDefines for what subgraphs should be fingerprints constructed\n";
   std::cout << "        \t<EDGES-FILE>     \tDefines what nodes are connected by an edge\n";
   std::cout << "    File Formats:\n";
   std::cout << "        \tk                \tFingerprints are stored in binary files splitted in directories based on features of central residues\n";
-  std::cout << "        \tq                \tAll fingerprints are stored in a single text file\n\n";
+  std::cout << "        \tq                \tAll fingerprints are stored in a single text file\n";
+  std::cout << "        \tp                \tAll fingerprints are stored in a single binary file packed in the same way as in a knowledge-base\n\n";
 
   std::cout << "Notes:\tDue to performancy reasons (saving RAM consumption), there are following expectations:\n";
   std::cout << "      \t\tRecords in <INDEX-FILE> are grouped by 'protein_name', then by 'model_name' and finally by 'chain_name' columns;\n";
@@ -64,6 +68,26 @@ int main(int argc, const char** argv) {
   };
   argv = arg;
 #endif // TESTING
+  size_t threads = 1;
+  if (argc > 1 && strncmp(argv[1], "-t", 2) == 0) {
+    int value;
+    try {
+      value = std::stoi(std::string(argv[1]).substr(2));
+    } catch (const std::exception&) {
+      std::cerr << "Invalid number of threads: '" << argv[1] << "'" << std::endl;
+      help();
+      return 4;
+    }
+    if (value < 1) {
+      std::cerr << "Number of threads must be positive: '" << argv[1] << "'" << std::endl;
+      help();
+      return 5;
+    }
+    threads = value;
+    // The rest of arguments is positional
+    ++argv;
+    --argc;
+  }
   if (argc < 7) {
     if (argc > 1) {
       std::cerr << "Unexpected number of arguments:";
@@ -78,6 +102,7 @@ int main(int argc, const char** argv) {
 
   try {
     inspire::backend::FingerprintWriter fingerprints(argv[4], argv[5]);
+    fingerprints.threads(threads);
     for (size_t i = 7; i < argc; i++) {
       fingerprints.add_features(argv[i]);
     }
@@ -92,6 +117,9 @@ int main(int argc, const char** argv) {
       case 'q':
         fingerprints.process(argv[3], argv[6], argv[2], inspire::backend::FingerprintFormat::Text);
         break;
+      case 'p':
+        fingerprints.process(argv[3], argv[6], argv[2], inspire::backend::FingerprintFormat::Packed);
+        break;
       default:
         break;
     }
@@ -1,5 +1,5 @@
 // inspire.cpp : Defines the entry point for the console application.
-// Last error id: 23
+// Last error id: 30
 
 //#define TESTING
 #ifdef TESTING
@@ -12,6 +12,7 @@
 #include "../backend/subgraphs.h"
 #include "../backend/fingerprints.h"
 #include "../backend/mine.h"
+#include "../backend/update.h"
 #include "../backend/classify.h"
 #include "../backend/predict.h"
 #include "../backend/assign.h"
@@ -36,10 +37,12 @@ static const std::string NODES_FILE = "nodes.sup";
 static const std::string EDGES_FILE = "edges.sup";
 static const std::string QUERY_FILE = "fingerprints.fit";
 static const std::string FINGERPRINTS_FILE = "settings.json";
+static const std::string IMAGE_FILE = "fingerprints.fim";
 static const std::string MINED_FILE = "mined.med";
 static const std::string STATISTICS_FILE = "ratios.sas";
 static const std::string PREDICTION_FILE = "prediction.pec";
 static const std::string OUTPUT_FILE = "output";
+static const std::string UPDATE_DIRECTORY = "update";
 static const double DEFAULT_DISTANCE = 0.5;
 
 // Initialize dictionary file for aminoacids
@@ -178,6 +181,36 @@ static void create_max_sasa_file(std::string path) {
   masa.close();
 }
 
+// Create an iterator selected by a switcher of the construction mode ('' for the default iterator), returns nullptr for an unknown switcher
+static inspire::backend::ProteinIterator* create_iterator(const std::string &arg_it) {
+  if (arg_it == "-c") {
+    return new inspire::backend::FirstModelCrystallographicIterator();
+  } else if (arg_it == "-b") {
+    return new inspire::backend::BiomoleculesIterator();
+  } else if (arg_it == "-bc") {
+    return new inspire::backend::AllExceptAltLocIterator();
+  } else if (arg_it == "-w") {
+    return new inspire::backend::ExplicitIterator();
+  } else if (arg_it.empty()) {
+    return new inspire::backend::FirstModelIterator();
+  }
+  return nullptr;
+}
+
+// Remove proteins from the knowledge-base, append structures processed in <temp_dir> (if it is not empty) and recompile the image
+static void update_knowledge_base(const std::string &knowledge_base, const std::vector<std::string> &removed, const std::string &temp_dir) {
+  inspire::backend::KnowledgeBaseUpdate update(knowledge_base, INDEX_FILE, INTERFACES_FILE);
+  for (auto removed_it = removed.begin(); removed_it != removed.end(); ++removed_it) {
+    if (update.remove(*removed_it) == 0) {
+      std::cerr << "Protein '" << *removed_it << "' is not in the knowledge-base.\n";
+    }
+  }
+  if (!temp_dir.empty()) {
+    update.append(temp_dir + INDEX_FILE, temp_dir + INTERFACES_FILE, common::filesystem::enclose_directory_name(temp_dir + UPDATE_DIRECTORY));
+  }
+  update.compile(knowledge_base + IMAGE_FILE);
+}
+
 // Prints an information about this program
 static void help() {
   std::cout << "Help\n\n";
@@ -185,13 +218,14 @@ static void help() {
   std::cout << "Make a prediction of protein-protein interaction sites using INSPiRE method, resp. construct a knowledge-base for that.\n";
   std::cout << "INSPiRE is a knowledge-based method that uses fingerprints to encode local structure of individual residues.\n";
   std::cout << "Details about the method can be found in doi : 10.1186/s12859-017-1921-4.\n\n";
-  //ABCDEGHIJKLMNOPQRTUVWXYZadfrtuyz
-  std::cout << "Usage:\t[-s <PROTEINS-PATH>+] (-S <PROTEIN-FILE>)* [-x<TEMP-DIR>] [-k<KNOWLEDGE-BASE>] [-p<THREADS>] [-n<COUNT>] [-o<CENTRAL-FEATURES>] [-j<EXCLUDE-FILE>] [-l<THRESHOLDS>] [-q<OUTPUT-PATH>] [-r(x|c<delimiter>|l)]\n";
-  std::cout << "      \t[-s <PROTEINS-PATH>+] (-S <PROTEIN-FILE>)* [-x<TEMP-DIR>] [-k<KNOWLEDGE-BASE>] -m [-b|-c|-bc|-w] [-i<RADII-FILE>[<DISTANCE>] [-F ( -a<TRANSFORMATION-FILE> | -e";
+  //BCDEGHIJKLMNOPQRUVWXYZafrtyz
+  std::cout << "Usage:\t[-s <PROTEINS-PATH>+] (-S <PROTEIN-FILE>)* [-x<TEMP-DIR>] [-k<KNOWLEDGE-BASE>] [-T<THREADS>] [-p<THREADS>] [-n<COUNT>] [-A<TABLES>] [-o<CENTRAL-FEATURES>] [-j<EXCLUDE-FILE>] [-l<THRESHOLDS>] [-q<OUTPUT-PATH>] [-r(x|c<delimiter>|l)]\n";
+  std::cout << "      \t[-s <PROTEINS-PATH>+] (-S <PROTEIN-FILE>)* [-x<TEMP-DIR>] [-k<KNOWLEDGE-BASE>] [-T<THREADS>] -m [-b|-c|-bc|-w] [-i<RADII-FILE>[<DISTANCE>] [-F ( -a<TRANSFORMATION-FILE> | -e";
 #ifdef FREESASA
   std::cout << " | -r[[<RADII-FILE>;[<COMPOSITION-FILE>;]]<MAX-SASA-FILE>]";
 #endif // FREESASA
   std::cout << " | -t | -x(s|f)<FEATURE-FILE> )* -f] [-v[c[<LIMIT>]|d[<DISTANCE>]|e[<DISTANCE>[-<LIMIT>]]]] [-e[c[<LIMIT>]|d[<DISTANCE>]|e[<DISTANCE>[-<LIMIT>]]]] [-g<FINGERPRINTS-FORMAT>]\n";
+  std::cout << "      \t[-s <PROTEINS-PATH>+] (-S <PROTEIN-FILE>)* [-x<TEMP-DIR>] [-k<KNOWLEDGE-BASE>] [-T<THREADS>] -u (-d<PROTEIN-ID>)*\n";
   std::cout << "      \t-h\n\n";
 
   std::cout << "Options:\t-s <PROTEINS-PATH>          \tPath to a protein or a directory with proteins that should be used\n";
@@ -205,11 +239,16 @@ static void help() {
   std::cout << "        \t-k<KNOWLEDGE-BASE>          \tPath to a directory, where is/ should be stored a knowledge-base.\n";
   std::cout << "        \t                            \tIf the directory does not exist, it is created.\n";
   std::cout << "        \t                            \tWithout the switcher, the current directory ('.') is used defaultly\n";
+  std::cout << "        \t-T <THREADS>                \tNumber of threads that should be used for construction of fingerprints. Default value is 1.\n";
+  std::cout << "        \t                            \tFingerprints are the same for any number of threads.\n";
   std::cout << "        \t-p <THREADS>                \tNumber of threads that should be used for data mining. Default value is 1.\n";
   std::cout << "        \t-n <COUNT>                  \tNumber of the most similar elements that will be used for prediction.\n";
   std::cout << "        \t                            \tIf multiple fingerprints have the same similarity score,\n";
   std::cout << "        \t                            \tall fingerprints with the score equal to the score of the n-th most similar element are used too.\n";
   std::cout << "        \t                            \tDefault value is 1.\n";
+  std::cout << "        \t-A<TABLES>                  \tApproximate search of the most similar elements using locality-sensitive hashing with <TABLES> hash tables.\n";
+  std::cout << "        \t                            \tIt is much faster for large knowledge-bases, but some of the most similar elements can be missed;\n";
+  std::cout << "        \t                            \tmore tables mean a higher recall and a slower search (see 'mine -v' to measure the recall).\n";
   std::cout << "        \t-o <CENTRAL-FEATURES>       \tWhat features of central residues will be used for prefiltering of knowledge-base.\n";
   std::cout << "        \t                            \tMultiple features must be separated by a directory separator.\n";
   std::cout << "        \t                            \tDefault feature is amino acid type.\n";
@@ -224,6 +263,11 @@ static void help() {
   std::cout << "        \t                            \tIf <OUTPUT-PATH> does not end with an appropriate extension, the extension is appended.\n";
   std::cout << "        \t                            \tWithout the switcher, prediction is printed to standard output.\n";
   std::cout << "        \t-m                          \tConstruction mode: knowledge-base will be constructed instead of used for prediction.\n";
+  std::cout << "        \t                            \tA precompiled image of the knowledge-base is stored too, it is used for predictions with the default <CENTRAL-FEATURES>.\n";
+  std::cout << "        \t-u                          \tUpdate mode: the given structures are added to an existing knowledge-base without its reconstruction,\n";
+  std::cout << "        \t                            \tthey are processed with the settings used during the construction of the knowledge-base.\n";
+  std::cout << "        \t                            \tA structure that is already in the knowledge-base is replaced. The precompiled image is recompiled.\n";
+  std::cout << "        \t-d<PROTEIN-ID>              \tRemove the protein from the knowledge-base in the update mode.\n";
   std::cout << "        \t-i<RADII-FILE>[<DISTANCE>]  \tRedefines radii of chemical elements using <RADII-FILE> and\n";
   std::cout << "        \t                            \toptionally <DISTANCE> resets the maximal allowed distance of two radiuses (0.5 Å is a default value) to be classified as an interface.\n";
   std::cout << "        \t                            \t<DISTANCE> must be separated by a space from <RADII-FILE>.\n";
@@ -300,6 +344,10 @@ int main(int argc, const char** argv) {
   try {
     // Whether the app run in prediction, or construction mode
     bool predict = true;
+    // Whether an existing knowledge-base is updated; its configuration is read in the same way as in the prediction mode
+    bool update = false;
+    // Proteins that should be removed from the knowledge-base in the update mode
+    std::vector<std::string> removed;
     // Complexes to precess
     std::vector<std::string> structures;
     // Where the knowledge base is/ should be store(d)
@@ -312,6 +360,8 @@ int main(int argc, const char** argv) {
     std::string temp_dir;
     // Whether to delete temporary files and directory
     bool delete_tmp = true;
+    // Number of threads constructing fingerprints
+    size_t fingerprint_threads = 1;
     // Index in argv
     size_t argv_index = 0;
 
@@ -335,10 +385,35 @@ int main(int argc, const char** argv) {
             delete_tmp = false;
           } else if (argv[argv_index][1] == 'k') {
             knowledge_base = common::filesystem::enclose_directory_name(std::string(argv[argv_index]).substr(2));
+          } else if (argv[argv_index][1] == 'T') {
+            if (strlen(argv[argv_index]) == 2) {
+              std::cerr << "Missing integer in number of threads constructing fingerprints switcher.\n";
+              return 28;
+            }
+            int threads = std::stoi(std::string(argv[argv_index]).substr(2));
+            if (threads < 1) {
+              std::cerr << "Number of threads constructing fingerprints must be positive.\n";
+              return 29;
+            }
+            fingerprint_threads = threads;
           } else if (argv[argv_index][1] == 'm') {
             predict = false;
             ++argv_index;
             break;
+          } else if (argv[argv_index][1] == 'u') {
+            update = true;
+            while (++argv_index < argc && common::string::starts_with(argv[argv_index], "-d")) {
+              if (strlen(argv[argv_index]) == 2) {
+                std::cerr << "Missing protein identifier in the removal switcher.\n";
+                return 25;
+              }
+              removed.push_back(std::string(argv[argv_index]).substr(2));
+            }
+            if (argv_index < argc) {
+              std::cerr << "Unexpected switcher '" << argv[argv_index] << "' in the update mode.\n";
+              return 26;
+            }
+            break;
           } else {
             break;
           }
@@ -362,6 +437,11 @@ int main(int argc, const char** argv) {
           return 4;
         }
         config_file.open(config_name, std::fstream::in);
+        if (update && structures.empty()) {
+          // Nothing to process, proteins are only removed
+          update_knowledge_base(knowledge_base, removed, "");
+          return 0;
+        }
       } else {
         if (!(common::filesystem::exists(knowledge_base) || common::filesystem::create_directory_recursive(knowledge_base))) {
           std::cerr << "It is not possible to create knowledge base directory '" << knowledge_base << "'.\n"
@@ -387,6 +467,10 @@ int main(int argc, const char** argv) {
           return 7;
         }
       } else {
+        if (update && temp_dir == knowledge_base) {
+          std::cerr << "Temporary directory must differ from the knowledge base directory in the update mode.\n";
+          return 27;
+        }
         if (!(common::filesystem::is_directory(temp_dir) || common::filesystem::create_directory_recursive(temp_dir))) {
           std::cerr << "It is not possible to create temporary directory '" << temp_dir << "'.\n"
             << "  It can occur e.g. if it is an invalid name or some prefix of the path corresponds to an existing file that is not a directory.\n";
@@ -402,44 +486,50 @@ int main(int argc, const char** argv) {
 #pragma region Index
     {
       if (predict) {
-        std::string bin;
-        if (!std::getline(config_file, bin)) {
+        std::string arg_it;
+        if (!std::getline(config_file, arg_it)) {
           std::cerr << "Unexpected end of the configuration file '" << config_name << "'.\n";
           return 9;
         }
-        it = new inspire::backend::ExplicitIterator();
+        // New structures of a knowledge-base must be iterated in the same way as during its construction
+        it = update ? create_iterator(arg_it) : new inspire::backend::ExplicitIterator();
+        if (it == nullptr) {
+          std::cerr << "Unexpected iterator '" << arg_it << "' in the configuration file '" << config_name << "'.\n";
+          return 9;
+        }
       } else {
         std::string arg_it;
         if (argv_index < argc) {
           arg_it = argv[argv_index];
         }
-        if (arg_it == "-c") {
-          it = new inspire::backend::FirstModelCrystallographicIterator();
-          ++argv_index;
-        } else if (arg_it == "-b") {
-          it = new inspire::backend::BiomoleculesIterator();
-          ++argv_index;
-        } else if (arg_it == "-bc") {
-          it = new inspire::backend::AllExceptAltLocIterator();
-          ++argv_index;
-        } else if (arg_it == "-w") {
-          it = new inspire::backend::ExplicitIterator();
-          ++argv_index;
-        } else {
+        it = create_iterator(arg_it);
+        if (it == nullptr) {
           arg_it = "";
-          it = new inspire::backend::FirstModelIterator();
+          it = create_iterator(arg_it);
+        } else if (!arg_it.empty()) {
+          ++argv_index;
         }
         config_file << arg_it << std::endl;
       }
-      inspire::backend::Indexer indexer(index_name, it, filter);
-      for (auto structures_it = structures.begin(); structures_it != structures.end(); ++structures_it) {
-        indexer.process(*structures_it);
+      {
+        inspire::backend::Indexer indexer(index_name, it, filter);
+        for (auto structures_it = structures.begin(); structures_it != structures.end(); ++structures_it) {
+          indexer.process(*structures_it);
+        }
+      }
+      if (!predict) {
+        // The index is a part of the knowledge-base to allow its updates
+        if (temp_dir != knowledge_base) {
+          common::filesystem::copy(index_name, knowledge_base + INDEX_FILE);
+        }
+        common::filesystem::remove_file(knowledge_base + inspire::backend::TOMBSTONES_FILE());
       }
     }
 #pragma endregion Index
 
     std::string coordinates_name = temp_dir + COORDINATES_FILE;
-    std::string interfaces_name = knowledge_base + INTERFACES_FILE;
+    // Labels of new structures are appended to the knowledge-base at the end of the update mode
+    std::string interfaces_name = (update ? temp_dir : knowledge_base) + INTERFACES_FILE;
     std::string features_name = temp_dir + FEATURES_FILE;
     std::set<std::string> filters;
 #pragma region Features
@@ -465,7 +555,7 @@ int main(int argc, const char** argv) {
       delete features.back();
 
       // Identify interfaces
-      if (predict) {
+      if (predict && !update) {
         std::string bin;
         if (!std::getline(config_file, bin)) {
           std::cerr << "Unexpected end of the configuration file '" << config_name << "'.\n";
@@ -577,9 +667,6 @@ int main(int argc, const char** argv) {
             return 11;
           }
         }
-        for (auto features_it = features.begin(); features_it != features.end(); ++features_it) {
-          filters.emplace((*features_it)->title());
-        }
       } else {
         if (argv_index < argc && common::string::starts_with(argv[argv_index], "-F")) {
           while (++argv_index < argc && argv[argv_index] != std::string("-f")) {
@@ -679,6 +766,9 @@ int main(int argc, const char** argv) {
         }
         config_file << "--" << std::endl;
       }
+      for (auto features_it = features.begin(); features_it != features.end(); ++features_it) {
+        filters.emplace((*features_it)->title());
+      }
       extractor.extract_features(features_name, features);
       for (auto features_it = features.begin(); features_it != features.end(); ++features_it) {
         delete *features_it;
@@ -841,8 +931,11 @@ int main(int argc, const char** argv) {
     {
       inspire::backend::FingerprintWriter fingerprints(index_name, nodes_name);
       fingerprints.add_features(features_name);
+      fingerprints.threads(fingerprint_threads);
       std::string fingerprints_name = knowledge_base + FINGERPRINTS_FILE;
-      if (predict) {
+      if (update) {
+        fingerprints.process(fingerprints_name, edges_name, common::filesystem::enclose_directory_name(temp_dir + UPDATE_DIRECTORY), inspire::backend::FingerprintFormat::Binary);
+      } else if (predict) {
         fingerprints.process(fingerprints_name, edges_name, query_name, inspire::backend::FingerprintFormat::Text);
       } else {
         if (argv_index < argc && common::string::starts_with(argv[argv_index], std::string("-g"))) {
@@ -860,11 +953,26 @@ int main(int argc, const char** argv) {
     }
 #pragma endregion Fingerprints
 
+    std::string image_name = knowledge_base + IMAGE_FILE;
+#pragma region Image
+    if (!predict) {
+      // Precompiled knowledge-base for the default features of central residues
+      inspire::backend::Mine(knowledge_base, filters, 1, 1).compile(image_name);
+    }
+#pragma endregion Image
+
+#pragma region Update
+    if (update) {
+      update_knowledge_base(knowledge_base, removed, temp_dir);
+    }
+#pragma endregion Update
+
     std::string mined_name = temp_dir + MINED_FILE;
 #pragma region Mining
-    if (predict) {
+    if (predict && !update) {
       int threads = 1;
       int limit = 1;
+      int tables = 0;
       for (; argv_index < argc && strlen(argv[argv_index]) > 1 && argv[argv_index][0] == '-'; ++argv_index) {
         if (argv[argv_index][1] == 'p') {
           if (strlen(argv[argv_index]) == 2) {
@@ -878,6 +986,16 @@ int main(int argc, const char** argv) {
             return 16;
           }
           limit = std::stoi(std::string(argv[argv_index]).substr(2));
+        } else if (argv[argv_index][1] == 'A') {
+          if (strlen(argv[argv_index]) == 2) {
+            std::cerr << "Missing integer in switcher saying how many hash tables should be used for approximate search.\n";
+            return 24;
+          }
+          tables = std::stoi(std::string(argv[argv_index]).substr(2));
+          if (tables < 1) {
+            std::cerr << "Number of hash tables for approximate search must be positive.\n";
+            return 30;
+          }
         } else if (argv[argv_index][1] == 'o') {
           filters.clear();
           std::stringstream parts(argv[argv_index]);
@@ -891,7 +1009,12 @@ int main(int argc, const char** argv) {
           break;
         }
       }
-      inspire::backend::Mine mine(knowledge_base, filters, threads, limit);
+      // The image is used only if it was compiled for the same features of central residues (i.e. '-o' switcher was not used)
+      inspire::backend::Mine mine(inspire::backend::Mine::has_image(image_name, filters) ? image_name : knowledge_base, filters, threads, limit);
+      if (tables > 0) {
+        mine.tables(tables);
+        mine.engine("lsh");
+      }
       for (; argv_index < argc && common::string::starts_with(argv[argv_index], "-j"); ++argv_index) {
         mine.load_excludes(std::string(argv[argv_index]).substr(2));
       }
@@ -901,7 +1024,7 @@ int main(int argc, const char** argv) {
 
     std::string statistics_name = temp_dir + STATISTICS_FILE;
 #pragma region Classify
-    if (predict) {
+    if (predict && !update) {
       inspire::backend::Classifier classifier(interfaces_name);
       classifier.classify(mined_name, statistics_name);
     }
@@ -909,7 +1032,7 @@ int main(int argc, const char** argv) {
 
     std::string prediction_name = temp_dir + PREDICTION_FILE;
 #pragma region Predict
-    if (predict) {
+    if (predict && !update) {
       inspire::backend::Predictor* predictor = nullptr;
       if (argv_index < argc && common::string::starts_with(argv[argv_index], "-l")) {
         if (strlen(argv[argv_index]) == 2) {
@@ -929,7 +1052,7 @@ int main(int argc, const char** argv) {
 #pragma endregion Predict
 
 #pragma region Assign
-    if (predict) {
+    if (predict && !update) {
       bool save = argv_index < argc && common::string::starts_with(argv[argv_index], "-q");
       std::string output_name = temp_dir + OUTPUT_FILE;
       if (save) {
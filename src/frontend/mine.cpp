@@ -4,7 +4,9 @@
 #include "../common/filesystem.h"
 #include "../common/string.h"
 #include "../common/exception.h"
+#include "../backend/ensemble.h"
 #include "../backend/mine.h"
+#include "../backend/shards.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -16,26 +18,71 @@ void help() {
 
   std::cout << "For each query fingerprint finds indices of k-most similar fingerprints with the same features of the central residue in the knowledge-base.\n\n";
 
-  std::cout << "Usage:\t([-t <THREADS>] [-n <COUNT>] [-C] [-c <CENTRAL-FEATURES>] -k <KNOWLEDGE-BASE> ([-S] [-s <SIBLINGS-FILE>] [-p] <QUERY-FILE> <OUTPUT-PATH>)+)+\n";
+  std::cout << "Usage:\t([-t <THREADS>] [-n <COUNT>] [-e <ENGINE>] [-r <TABLES>] [-b <QUERIES>] [-x <ENTRIES>] [-C] [-c <CENTRAL-FEATURES>] [-d <SHARD>/<SHARDS> | -D <SHARDS>] [-a] -k <KNOWLEDGE-BASE> [-K <KNOWLEDGE-BASE>]* [-y <CACHE-FILE>] [-i <IMAGE-FILE>] [-l <TIMINGS-FILE>] ([-S] [-s <SIBLINGS-FILE>] [-p] <QUERY-FILE> <OUTPUT-PATH> [-q <INGESTION-FILE>] [-A <NUMA-FILE>] [-Y <CACHE-STATISTICS-FILE>] | -v <SAMPLE> <QUERY-FILE> <EVALUATION-FILE>)*)+\n";
+  std::cout << "      \t-m <COUNT> <PARTIAL-RESULT>{<COUNT>} <OUTPUT-PATH>\n";
   std::cout << "      \t-h\n\n";
 
-  std::cout << "Options:\t-t <THREADS>           \tNumber of threads that should be used for data mining. Default value is 1.\n";
+  std::cout << "Options:\t-t <THREADS>           \tNumber of threads that should be used for data mining and for loading of a knowledge-base. Default value is 1.\n";
+  std::cout << "        \t                       \tResults are always written in the order of the query file.\n";
   std::cout << "        \t-n <COUNT>             \tNumber of the most similar elements that will be returned.\n";
   std::cout << "        \t                       \tIf multiple fingerprints have the same similarity score, all fingerprints with the score equal to the score of the <COUNT>-th most similar element are returned too.\n";
   std::cout << "        \t                       \tDefault value is 1.\n";
+  std::cout << "        \t-e <ENGINE>            \tHow the most similar fingerprints are searched. 'scan', 'mih' and 'pivot' engines return the same results.\n";
+  std::cout << "        \t                       \t'scan' compares a query with fingerprints with the same features of the central residue, fingerprints whose popcount differs too much are skipped.\n";
+  std::cout << "        \t                       \t'mih' builds a multi-index hashing index for each large group of fingerprints, so only fingerprints similar to a query are compared.\n";
+  std::cout << "        \t                       \t'pivot' stores distances of fingerprints from a few pivots, fingerprints that are too far according to the triangle inequality are skipped.\n";
+  std::cout << "        \t                       \t'lsh' compares a query only with fingerprints that share sampled bits with the query in any of <TABLES> hash tables.\n";
+  std::cout << "        \t                       \tIt is approximate, i.e. some of the most similar fingerprints can be missed, but it is much faster for large groups of fingerprints.\n";
+  std::cout << "        \t                       \tIndices are built when a knowledge-base is loaded and require additional memory. Default value is 'scan'.\n";
+  std::cout << "        \t-r <TABLES>            \tNumber of hash tables of 'lsh' engine, more tables mean a higher recall and a slower search. Default value is 8.\n";
+  std::cout << "        \t-b <QUERIES>            \tNumber of queries with the same features of the central residue that are searched at once.\n";
+  std::cout << "        \t                       \tQueries are grouped, then a group is scanned once for all its queries in blocks that stay in the cache.\n";
+  std::cout << "        \t                       \tDefault value is 1, i.e. queries are searched one by one.\n";
+  std::cout << "        \t-x <ENTRIES>            \tMaximal number of cached results of queries. Queries with the same features of the central residue, fingerprint\n";
+  std::cout << "        \t                       \tand siblings (e.g. residues of repeated chains) are searched only once. 0 disables the cache. Default value is 65536.\n";
   std::cout << "        \t-c <CENTRAL-FEATURES>  \tWhat features of central residues will be used for prefiltering of knowledge-base.\n";
   std::cout << "        \t                       \tMultiple features must be separated by a directory separator.\n";
   std::cout << "        \t-C                     \tClean filtering previously set with '-c' switch.\n";
-  std::cout << "        \t-k <KNOWLEDGE-BASE>    \tPath to the root directory of a knowledge-base.\n";
+  std::cout << "        \t-k <KNOWLEDGE-BASE>    \tPath to the root directory of a knowledge-base, or to a knowledge-base image created with '-i' switch.\n";
+  std::cout << "        \t                       \tAn image is mapped into memory instead of being parsed, thus mining can start immediately and the memory is shared among concurrent processes.\n";
+  std::cout << "        \t                       \tAn image can be used only with the same <CENTRAL-FEATURES> as it was created with.\n";
+  std::cout << "        \t-K <KNOWLEDGE-BASE>    \tMine query files with another knowledge-base together with the knowledge-base loaded with the last '-k' switch.\n";
+  std::cout << "        \t                       \tEach query file is read once and all knowledge-bases are searched by the same threads, results of the i-th knowledge-base\n";
+  std::cout << "        \t                       \t(counted from 0 in the order of '-k' and '-K' switches) are written into '<OUTPUT-PATH>.kb<I>.med'. The same <CENTRAL-FEATURES> must be used.\n";
+  std::cout << "        \t                       \tLater settings and siblings files apply to all knowledge-bases, '-i', '-l', '-q', '-A', '-y', '-Y' and '-v' switches to the first one only.\n";
+  std::cout << "        \t-y <CACHE-FILE>         \tLoad cached results of queries from <CACHE-FILE> if it was stored for the same knowledge-base and engine,\n";
+  std::cout << "        \t                       \tand store all cached results into <CACHE-FILE> after each <QUERY-FILE>, so they are reused by next runs.\n";
+  std::cout << "        \t-d <SHARD>/<SHARDS>     \tLoad only the shard no. <SHARD> (counted from 0) out of <SHARDS> of the next knowledge-base.\n";
+  std::cout << "        \t                       \tGroups of fingerprints with the same features of the central residue are assigned to shards, so the shards have similar sizes.\n";
+  std::cout << "        \t                       \tQueries whose group is in another shard get empty results, partial results of all shards can be combined with '-m' switch.\n";
+  std::cout << "        \t-D <SHARDS>             \tMine each query file with the next knowledge-base by <SHARDS> local processes, each of them loads only its shard.\n";
+  std::cout << "        \t                       \tPartial results are merged, so the output is the same as without sharding. '-i', '-l', '-q', '-A', '-y', '-Y' and '-v' switches cannot be used then.\n";
+  std::cout << "        \t-a                     \tSpread groups of the next knowledge-base over NUMA nodes and pin threads of mining to nodes owning groups they search.\n";
+  std::cout << "        \t                       \tThreads of a node search queries of groups owned by other nodes only when there is nothing left for the node.\n";
+  std::cout << "        \t                       \tNothing is placed or pinned on a machine with a single NUMA node.\n";
+  std::cout << "        \t-m <COUNT> <PARTIAL-RESULT>{<COUNT>} <OUTPUT-PATH>\n";
+  std::cout << "        \t                       \tMerge partial results of all shards created for the same query file into a single output file.\n";
+  std::cout << "        \t-i <IMAGE-FILE>        \tStore the knowledge-base loaded with the last '-k' switch as an image.\n";
+  std::cout << "        \t-l <TIMINGS-FILE>      \tWrite how long it took to read individual files and to pack individual groups of the knowledge-base loaded with the last '-k' switch.\n";
   std::cout << "        \t-s <SIBLINGS-FILE>     \tPath to a file with defining, what knowledge-base's fingerprints should be skipped when mining most similar fingerprints for individual query fingerprints.\n";
   std::cout << "        \t                       \tThis is usefull for benchmarking to exclude fingerprints from the same protein/ benchmark instead of construction of new knowledge-base for each benchmark.\n";
   std::cout << "        \t-S                     \tClean siblings previously set with '-s' switch.\n";
   std::cout << "        \t<QUERY-FILE>           \tA path to a file with query fingerprints for which the most similar elements should be find.\n";
+  std::cout << "        \t                       \tBoth text ('.fit') and packed ('.fiq') query files created by fingerprints are accepted, the format is recognized from the content.\n";
   std::cout << "        \t-p                     \tA switcher saying that the next one argument will be a <QUERY-FILE>.\n";
   std::cout << "        \t                       \tThis switcher is mandatory if a <QUERY-FILE> starts with a hyphen-minus sign.\n";
   std::cout << "        \t<OUTPUT-PATH>          \tWhere to store output file.\n";
   std::cout << "        \t                       \tIf <OUTPUT-PATH> is empty or ends with a directory separator, <QUERY-FILE>'s basename is used as the file name with '.med' as an extension.\n";
   std::cout << "        \t                       \tIf <OUTPUT-PATH> does not end with '.med' extension, the extension is appended.\n";
+  std::cout << "        \t-q <INGESTION-FILE>     \tWrite how many queries were read from the last <QUERY-FILE>, and how many times the reader waited for workers\n";
+  std::cout << "        \t                       \tbecause the queue of read queries was full, or workers waited for the reader because the queue was empty.\n";
+  std::cout << "        \t-A <NUMA-FILE>         \tWrite how many groups and fingerprints each NUMA node owns and how many queries of the last <QUERY-FILE>\n";
+  std::cout << "        \t                       \twere mined by threads of the node, including queries stolen from other nodes, and their throughput.\n";
+  std::cout << "        \t-Y <CACHE-STATISTICS-FILE>\n";
+  std::cout << "        \t                       \tWrite how many queries of the last <QUERY-FILE> were looked up and found in the cache of results.\n";
+  std::cout << "        \t-v <SAMPLE> <QUERY-FILE> <EVALUATION-FILE>\n";
+  std::cout << "        \t                       \tCompare the selected engine with 'scan' engine on a random sample of at most <SAMPLE> queries from <QUERY-FILE>.\n";
+  std::cout << "        \t                       \tThe mean recall@k (k is <COUNT>), times of both engines and numbers of compared fingerprints per query are written into <EVALUATION-FILE>.\n";
   std::cout << "        \t-h                     \tShow informations about the program\n\n";
 }
 
@@ -63,17 +110,116 @@ int main(int argc, const char** argv) {
   }
 
   inspire::backend::Mine* mine = nullptr;
+  // Used instead of 'mine' if the knowledge-base is mined by local processes of its shards
+  inspire::backend::LocalShards* shards = nullptr;
+  // Used instead of 'mine' if further knowledge-bases are mined together with it, it owns 'mine' then
+  inspire::backend::MineEnsemble* ensemble = nullptr;
   try {
     std::set<std::string> filters;
     int threads = 1;
     int limit = 1;
+    std::string engine = "scan";
+    int batch = 1;
+    int tables = 8;
+    int cache = 1 << 16;
+    // Only a shard of the next knowledge-base is loaded, or the next knowledge-base is mined by processes of all its shards
+    int shard = 0;
+    int shards_count = 1;
+    bool local_shards = false;
+    // Place the next knowledge-base on NUMA nodes
+    bool numa = false;
 
     for (int i = 1; i < argc; i++) {
       if (std::strlen(argv[i]) == 2 && argv[i][0] == '-') {
         switch (argv[i][1]) {
+          case 'a':
+            numa = true;
+            break;
+          case 'A':
+            if (++i >= argc) {
+              std::cerr << "Error: NUMA file is not specified";
+              help();
+              return 7973;
+            }
+            if (mine == nullptr) {
+              std::cerr << "Error: Knowledge base is not specified yet";
+              help();
+              return 7920;
+            }
+            {
+              std::ofstream statistics(argv[i]);
+              mine->numa(statistics);
+            }
+            break;
+          case 'b':
+            if (++i >= argc) {
+              std::cerr << "Error: Number of queries in a batch is not specified";
+              help();
+              return 3688;
+            }
+            batch = std::stoi(argv[i]);
+            if (batch < 1) {
+              std::cerr << "Error: Number of queries in a batch must be positive";
+              help();
+              return 3698;
+            }
+            if (ensemble != nullptr) {
+              ensemble->batch(batch);
+            } else if (mine != nullptr) {
+              mine->batch(batch);
+            }
+            if (shards != nullptr) {
+              shards->batch(batch);
+            }
+            break;
           case 'C':
             filters.clear();
             break;
+          case 'D':
+            if (++i >= argc) {
+              std::cerr << "Error: Number of shards is not specified";
+              help();
+              return 3690;
+            }
+            shards_count = std::max(std::stoi(argv[i]), 1);
+            shard = 0;
+            local_shards = true;
+            break;
+          case 'd':
+            if (++i >= argc) {
+              std::cerr << "Error: Shard is not specified";
+              help();
+              return 3691;
+            }
+            {
+              std::string value(argv[i]);
+              size_t slash = value.find('/');
+              if (slash == value.npos) {
+                std::cerr << "Error: Shard must be specified as '<SHARD>/<SHARDS>'";
+                help();
+                return 3692;
+              }
+              shard = std::stoi(value.substr(0, slash));
+              shards_count = std::max(std::stoi(value.substr(slash + 1)), 1);
+              local_shards = false;
+            }
+            break;
+          case 'e':
+            if (++i >= argc) {
+              std::cerr << "Error: Search engine is not specified";
+              help();
+              return 3687;
+            }
+            engine = argv[i];
+            if (ensemble != nullptr) {
+              ensemble->engine(engine);
+            } else if (mine != nullptr) {
+              mine->engine(engine);
+            }
+            if (shards != nullptr) {
+              shards->engine(engine);
+            }
+            break;
           case 'c':
             if (++i >= argc) {
               std::cerr << "Error: Considered features of central nodes are not specified";
@@ -92,18 +238,126 @@ int main(int argc, const char** argv) {
           case 'h':
             help();
             break;
+          case 'i':
+            if (++i >= argc) {
+              std::cerr << "Error: Image file is not specified";
+              help();
+              return 7969;
+            }
+            if (mine == nullptr) {
+              std::cerr << "Error: Knowledge base is not specified yet";
+              help();
+              return 7916;
+            }
+            mine->compile(argv[i]);
+            break;
           case 'k':
             if (++i >= argc) {
               std::cerr << "Error: Knowledge-base file is not specified";
               help();
               return 7968;
             }
+            if (ensemble != nullptr) {
+              delete ensemble;
+              ensemble = nullptr;
+              mine = nullptr;
+            }
             if (mine != nullptr) {
               delete mine;
+              mine = nullptr;
+            }
+            if (shards != nullptr) {
+              delete shards;
+              shards = nullptr;
             }
-            mine = new inspire::backend::Mine(argv[i], filters, threads, limit);
+            if (local_shards) {
+              shards = new inspire::backend::LocalShards(argv[i], filters, shards_count, threads, limit);
+              shards->tables(tables);
+              shards->engine(engine);
+              shards->batch(batch);
+              shards->numa(numa);
+              shards->cache(cache);
+            } else {
+              mine = new inspire::backend::Mine(argv[i], filters, threads, limit, shard, shards_count, numa);
+              mine->tables(tables);
+              mine->engine(engine);
+              mine->batch(batch);
+              mine->cache(cache);
+            }
+            // Sharding and NUMA placement apply to the next knowledge-base only
+            shard = 0;
+            shards_count = 1;
+            local_shards = false;
+            numa = false;
             // NOTE: For the case that the multiple predictions will be specified the next prediction will be without filtering.
             break;
+          case 'K':
+            if (++i >= argc) {
+              std::cerr << "Error: Knowledge-base file is not specified";
+              help();
+              return 7976;
+            }
+            if (local_shards) {
+              std::cerr << "Error: Knowledge-bases mined by processes of shards cannot be mined together";
+              help();
+              return 3696;
+            }
+            if (mine == nullptr) {
+              std::cerr << "Error: Knowledge base is not specified yet";
+              help();
+              return 7923;
+            }
+            if (ensemble == nullptr) {
+              ensemble = new inspire::backend::MineEnsemble();
+              ensemble->add(mine);
+            }
+            {
+              inspire::backend::Mine *added = new inspire::backend::Mine(argv[i], filters, threads, limit, shard, shards_count, numa);
+              ensemble->add(added);
+              added->tables(tables);
+              added->engine(engine);
+              added->batch(batch);
+              added->cache(cache);
+            }
+            break;
+          case 'l':
+            if (++i >= argc) {
+              std::cerr << "Error: Timings file is not specified";
+              help();
+              return 7970;
+            }
+            if (mine == nullptr) {
+              std::cerr << "Error: Knowledge base is not specified yet";
+              help();
+              return 7917;
+            }
+            {
+              std::ofstream timings(argv[i]);
+              mine->timings(timings);
+            }
+            break;
+          case 'm':
+            if (++i >= argc) {
+              std::cerr << "Error: Number of partial results is not specified";
+              help();
+              return 3693;
+            }
+            {
+              int count = std::stoi(argv[i]);
+              if (count < 1 || i + count + 1 >= argc) {
+                std::cerr << "Error: Partial results or the output file are not specified";
+                help();
+                return 3694;
+              }
+              std::vector<std::string> partials(argv + i + 1, argv + i + count + 1);
+              i += count + 1;
+              std::string output(argv[i]);
+              if (!common::string::ends_with(output, ".med")) {
+                output += ".med";
+              }
+              inspire::backend::Mine::merge(partials, output);
+            }
+            break;
           case 'n':
             if (++i >= argc) {
               std::cerr << "Error: Number of threads is not specified";
@@ -111,9 +365,14 @@ int main(int argc, const char** argv) {
               return 3215;
             }
             limit = std::stoi(argv[i]);
-            if (mine != nullptr) {
+            if (ensemble != nullptr) {
+              ensemble->limit(limit);
+            } else if (mine != nullptr) {
               mine->limit(limit);
             }
+            if (shards != nullptr) {
+              shards->limit(limit);
+            }
             break;
           case 'p': // Just for the case that the filename start as any switch
             if (++i >= argc) {
@@ -126,17 +385,65 @@ int main(int argc, const char** argv) {
               help();
               return 1542;
             }
-            if (mine == nullptr) {
+            if (mine == nullptr && shards == nullptr) {
               std::cerr << "Error: Knowledge base is not specified yet";
               help();
               return 7912;
             }
-            mine->select(argv[i-1], argv[i]);
+            if (shards != nullptr) {
+              shards->select(argv[i-1], argv[i]);
+            } else if (ensemble != nullptr) {
+              ensemble->select(argv[i-1], argv[i]);
+            } else {
+              mine->select(argv[i-1], argv[i]);
+            }
+            break;
+          case 'q':
+            if (++i >= argc) {
+              std::cerr << "Error: Ingestion file is not specified";
+              help();
+              return 7971;
+            }
+            if (mine == nullptr) {
+              std::cerr << "Error: Knowledge base is not specified yet";
+              help();
+              return 7918;
+            }
+            {
+              std::ofstream ingestion(argv[i]);
+              mine->ingestion(ingestion);
+            }
+            break;
+          case 'r':
+            if (++i >= argc) {
+              std::cerr << "Error: Number of hash tables is not specified";
+              help();
+              return 3689;
+            }
+            tables = std::stoi(argv[i]);
+            if (tables < 1) {
+              std::cerr << "Error: Number of hash tables must be positive";
+              help();
+              return 3699;
+            }
+            if (ensemble != nullptr) {
+              ensemble->tables(tables);
+            } else if (mine != nullptr) {
+              mine->tables(tables);
+            }
+            if (shards != nullptr) {
+              shards->tables(tables);
+            }
             break;
           case 'S':
-            if (mine != nullptr) {
+            if (ensemble != nullptr) {
+              ensemble->clear_excludes();
+            } else if (mine != nullptr) {
               mine->clear_excludes();
             }
+            if (shards != nullptr) {
+              shards->clear_excludes();
+            }
             break;
           case 's':
             if (++i >= argc) {
@@ -144,12 +451,18 @@ int main(int argc, const char** argv) {
               help();
               return 1553;
             }
-            if (mine == nullptr) {
+            if (mine == nullptr && shards == nullptr) {
               std::cerr << "Error: Knowledge base is not specified yet";
               help();
               return 7913;
             }
-            mine->load_excludes(argv[i]);
+            if (shards != nullptr) {
+              shards->load_excludes(argv[i]);
+            } else if (ensemble != nullptr) {
+              ensemble->load_excludes(argv[i]);
+            } else {
+              mine->load_excludes(argv[i]);
+            }
             break;
           case 't':
             if (++i >= argc) {
@@ -158,9 +471,81 @@ int main(int argc, const char** argv) {
               return 8975;
             }
             threads = std::stoi(argv[i]);
-            if (mine != nullptr) {
+            if (threads < 1) {
+              std::cerr << "Error: Number of threads must be positive";
+              help();
+              return 3697;
+            }
+            if (ensemble != nullptr) {
+              ensemble->threads(threads);
+            } else if (mine != nullptr) {
               mine->threads(threads);
             }
+            if (shards != nullptr) {
+              shards->threads(threads);
+            }
+            break;
+          case 'v':
+            if (i + 3 >= argc) {
+              std::cerr << "Error: Sample size, query file or evaluation file is not specified";
+              help();
+              return 7972;
+            }
+            if (mine == nullptr) {
+              std::cerr << "Error: Knowledge base is not specified yet";
+              help();
+              return 7919;
+            }
+            {
+              std::ofstream evaluation(argv[i + 3]);
+              mine->evaluate(argv[i + 2], std::stoi(argv[i + 1]), evaluation);
+            }
+            i += 3;
+            break;
+          case 'x':
+            if (++i >= argc) {
+              std::cerr << "Error: Size of the cache is not specified";
+              help();
+              return 3695;
+            }
+            cache = std::max(std::stoi(argv[i]), 0);
+            if (ensemble != nullptr) {
+              ensemble->cache(cache);
+            } else if (mine != nullptr) {
+              mine->cache(cache);
+            }
+            if (shards != nullptr) {
+              shards->cache(cache);
+            }
+            break;
+          case 'y':
+            if (++i >= argc) {
+              std::cerr << "Error: Cache file is not specified";
+              help();
+              return 7974;
+            }
+            if (mine == nullptr) {
+              std::cerr << "Error: Knowledge base is not specified yet";
+              help();
+              return 7921;
+            }
+            mine->cache_file(argv[i]);
+            break;
+          case 'Y':
+            if (++i >= argc) {
+              std::cerr << "Error: Cache statistics file is not specified";
+              help();
+              return 7975;
+            }
+            if (mine == nullptr) {
+              std::cerr << "Error: Knowledge base is not specified yet";
+              help();
+              return 7922;
+            }
+            {
+              std::ofstream statistics(argv[i]);
+              mine->cache_statistics(statistics);
+            }
             break;
           default: // Filename arbitrary starts with "-"
             if (++i >= argc) {
@@ -168,12 +553,18 @@ int main(int argc, const char** argv) {
               help();
               return 1542;
             }
-            if (mine == nullptr) {
+            if (mine == nullptr && shards == nullptr) {
               std::cerr << "Error: Knowledge base is not specified yet";
               help();
               return 7914;
             }
-            mine->select(argv[i - 1], argv[i]);
+            if (shards != nullptr) {
+              shards->select(argv[i - 1], argv[i]);
+            } else if (ensemble != nullptr) {
+              ensemble->select(argv[i - 1], argv[i]);
+            } else {
+              mine->select(argv[i - 1], argv[i]);
+            }
             break;
         }
       } else {
@@ -182,12 +573,18 @@ int main(int argc, const char** argv) {
           help();
           return 1542;
         }
-        if (mine == nullptr) {
+        if (mine == nullptr && shards == nullptr) {
           std::cerr << "Error: Knowledge base is not specified yet";
           help();
           return 7915;
         }
-        mine->select(argv[i - 1], argv[i]);
+        if (shards != nullptr) {
+          shards->select(argv[i - 1], argv[i]);
+        } else if (ensemble != nullptr) {
+          ensemble->select(argv[i - 1], argv[i]);
+        } else {
+          mine->select(argv[i - 1], argv[i]);
+        }
       }
     }
   } catch (const common::exception::TitledException& e) {
@@ -211,9 +608,14 @@ int main(int argc, const char** argv) {
     log << "UNKNOWN ERROR" << std::endl;
 #endif // TESTING
   }
-  if (mine != nullptr) {
+  if (ensemble != nullptr) {
+    delete ensemble;
+  } else if (mine != nullptr) {
     delete mine;
   }
+  if (shards != nullptr) {
+    delete shards;
+  }
 
   return 0;
 }
@@ -0,0 +1,191 @@
+// server.cpp : Defines the entry point for the console application.
+//
+
+#include "../backend/pipeline.h"
+#include "../common/exception.h"
+#include "../common/filesystem.h"
+#include "../common/socket.h"
+#include "../common/string.h"
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+//#define TESTING
+
+void help() {
+  std::cout << "Help\n\n";
+
+  std::cout << "Keep a knowledge-base created by inspire in memory and predict interfaces for structures received over a socket.\n";
+  std::cout << "Each request is processed in the same way as 'inspire -s <STRUCTURE>+ -k<KNOWLEDGE-BASE>', but the knowledge-base is loaded only once.\n\n";
+
+  std::cout << "Usage:\t[-k <KNOWLEDGE-BASE>] [-x <TEMPORARY-DIRECTORY>] [-w <WORKERS>] [-p <THREADS>] [-n <COUNT>] [-e <ENGINE>] [-l <THRESHOLDS>] [-j <SIBLINGS-FILE>]* <ENDPOINT>\n";
+  std::cout << "      \t-h\n\n";
+
+  std::cout << "Options:\t-k <KNOWLEDGE-BASE>       \tDirectory with a knowledge-base created by inspire. Default value is the current directory.\n";
+  std::cout << "        \t-x <TEMPORARY-DIRECTORY>  \tWhere temporary directories of individual requests are created. Default value is the current directory.\n";
+  std::cout << "        \t-w <WORKERS>              \tNumber of connections served in parallel. Default value is 1.\n";
+  std::cout << "        \t-p <THREADS>              \tNumber of threads used for data mining of a single request. Default value is 1.\n";
+  std::cout << "        \t-n <COUNT>                \tNumber of the most similar fingerprints that will be mined. Default value is 1.\n";
+  std::cout << "        \t-e <ENGINE>               \tHow the most similar fingerprints are searched, 'scan', 'mih' or 'pivot'. Default value is 'scan'.\n";
+  std::cout << "        \t-l <THRESHOLDS>           \tThresholds of the fractional predictor separated by spaces. Default value is '0.5175'.\n";
+  std::cout << "        \t-j <SIBLINGS-FILE>        \tWhat knowledge-base's fingerprints should be skipped for individual query fingerprints.\n";
+  std::cout << "        \t<ENDPOINT>                \tPort number on the loopback interface, or a path of a Unix domain socket.\n";
+  std::cout << "        \t-h                        \tShow informations about the program\n\n";
+
+  std::cout << "Protocol:\tA request is a line with tab-separated values '<FORMAT>(\\t<STRUCTURE>)+',\n";
+  std::cout << "         \twhere <FORMAT> is 'x' for XML, 'l' for the aligned list, 'c<DELIMITER>' for delimiter-separated values, or empty for tab-separated values,\n";
+  std::cout << "         \tand <STRUCTURE> is a path of a structure file or a directory on the machine running the server.\n";
+  std::cout << "         \tThe response is either a line 'OK\\t<SIZE>' followed by <SIZE> bytes of the output file, or a line 'ERROR\\t<MESSAGE>'.\n";
+  std::cout << "         \tA single connection can be used for several requests.\n\n";
+}
+
+// Serve requests of a single connection until it is closed
+void serve(inspire::backend::Pipeline &pipeline, common::socket::protocol::socket &socket) {
+  boost::asio::streambuf buffer;
+  std::string line;
+  while (common::socket::read_line(socket, buffer, line)) {
+    std::stringstream parts(line);
+    std::string format;
+    std::getline(parts, format, '\t');
+    std::vector<std::string> structures;
+    std::string part;
+    while (std::getline(parts, part, '\t')) {
+      structures.push_back(part);
+    }
+    std::string response;
+    try {
+      if (structures.empty()) {
+        throw common::exception::TitledException("No structure was specified");
+      }
+      if (!format.empty() && format != "x" && format != "l" && (format.size() != 2 || format[0] != 'c')) {
+        throw common::exception::TitledException("Unknown file format specifier: '" + format + "'");
+      }
+      const std::string &output = pipeline.predict(structures, format.empty() ? 'c' : format[0], format.size() == 2 ? format[1] : '\t');
+      response = "OK\t" + std::to_string(output.size()) + "\n" + output;
+    } catch (const common::exception::TitledException& e) {
+      response = std::string("ERROR\t") + e.what() + "\n";
+    } catch (const std::exception& e) {
+      response = std::string("ERROR\t") + e.what() + "\n";
+    } catch (...) {
+      response = "ERROR\tUnknown error\n";
+    }
+    common::socket::write(socket, response);
+  }
+}
+
+// Accept connections one by one
+void worker(inspire::backend::Pipeline &pipeline, common::socket::acceptor &acceptor, std::mutex &mutex) {
+  while (true) {
+    common::socket::protocol::socket socket(acceptor.get_executor());
+    // A failed connection (e.g. when there are too many open files) is reported and the worker accepts the next one
+    try {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        acceptor.accept(socket);
+      }
+      serve(pipeline, socket);
+    } catch (const std::exception& e) {
+      std::cerr << "ERROR: " << e.what() << std::endl;
+    }
+  }
+}
+
+int main(int argc, const char** argv) {
+  if (argc <= 1 || common::string::starts_with(argv[1], "-h")) {
+    help();
+    return 0;
+  }
+
+  try {
+    std::string knowledge_base = ".";
+    std::string temp_dir = "";
+    std::string engine = "scan";
+    std::string thresholds = "0.5175";
+    std::vector<std::string> excludes;
+    size_t workers = 1;
+    int threads = 1;
+    int limit = 1;
+    int argv_index = 0;
+    while (++argv_index < argc - 1) {
+      std::string argument(argv[argv_index]);
+      if (argument.size() != 2 || argument[0] != '-') {
+        std::cerr << "Unexpected argument '" << argument << "'.\n";
+        return 1;
+      }
+      std::string value(argv[++argv_index]);
+      switch (argument[1]) {
+        case 'k':
+          knowledge_base = value;
+          break;
+        case 'x':
+          temp_dir = common::filesystem::enclose_directory_name(value);
+          break;
+        case 'w':
+          workers = std::max(std::stoi(value), 1);
+          break;
+        case 'p':
+          threads = std::stoi(value);
+          break;
+        case 'n':
+          limit = std::stoi(value);
+          break;
+        case 'e':
+          engine = value;
+          break;
+        case 'l':
+          thresholds = value;
+          break;
+        case 'j':
+          excludes.push_back(value);
+          break;
+        default:
+          std::cerr << "Unknown switcher '" << argument << "'.\n";
+          return 2;
+      }
+    }
+    if (argv_index != argc - 1) {
+      std::cerr << "Missing endpoint.\n";
+      return 3;
+    }
+
+    inspire::backend::Pipeline pipeline(knowledge_base, temp_dir, threads, limit, thresholds);
+    pipeline.mine().engine(engine);
+    for (auto excludes_it = excludes.begin(); excludes_it != excludes.end(); ++excludes_it) {
+      pipeline.mine().load_excludes(*excludes_it);
+    }
+
+    boost::asio::io_context context;
+    common::socket::protocol::endpoint endpoint = common::socket::endpoint(argv[argv_index]);
+    common::socket::acceptor acceptor(context);
+    acceptor.open(endpoint.protocol());
+    if (endpoint.protocol().family() == AF_UNIX) {
+      // A socket file left by a previous server
+      common::filesystem::remove_file(argv[argv_index]);
+    } else {
+      acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen();
+    std::cerr << "Listening on '" << argv[argv_index] << "'" << std::endl;
+
+    std::mutex mutex;
+    std::vector<std::thread> threads_pool;
+    for (size_t i = 0; i < workers; i++) {
+      threads_pool.push_back(std::thread(worker, std::ref(pipeline), std::ref(acceptor), std::ref(mutex)));
+    }
+    for (auto threads_it = threads_pool.begin(); threads_it != threads_pool.end(); ++threads_it) {
+      threads_it->join();
+    }
+  } catch (const common::exception::TitledException& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 4;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 5;
+  } catch (...) {
+    std::cerr << "UNKNOWN ERROR" << std::endl;
+    return 6;
+  }
+
+  return 0;
+}